@@ -4,11 +4,21 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/heapprof.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/swap.h"
+#endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "filesys/filesys.h"
@@ -90,6 +100,11 @@ shutdown_power_off (void)
   const char s[] = "Shutdown";
   const char *p;
 
+  /* Writing out the trace needs disk interrupts, which is
+     impossible if we are shutting down from a panic. */
+  if (!intr_context () && intr_get_level () == INTR_ON)
+    trace_dump ();
+
 #ifdef FILESYS
   filesys_done ();
 #endif
@@ -119,6 +134,12 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  palloc_print_stats ();
+  malloc_print_stats ();
+  kmem_cache_print_stats ();
+#ifdef HEAPPROF
+  heapprof_dump ();
+#endif
 #ifdef FILESYS
   block_print_stats ();
 #endif
@@ -127,4 +148,8 @@ print_stats (void)
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  frame_print_stats ();
+  swap_print_stats ();
+#endif
 }
@@ -4,9 +4,11 @@
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
+#include "threads/apic.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -20,6 +22,58 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Hierarchical timer wheel holding pending timer events.
+
+   The innermost level has WHEEL_ROOT_SLOTS slots of one tick
+   each.  Each outer level has WHEEL_SLOTS slots, each slot
+   covering as many ticks as the whole of the level inside it.
+   An event is put in the innermost level that can hold its
+   expiry tick, so insertion and cancellation are O(1).  Every
+   tick only the current innermost slot is expired; when the
+   innermost level wraps around, the next slot of the level
+   above is cascaded down into the levels below it. */
+#define WHEEL_ROOT_BITS 8
+#define WHEEL_BITS 6
+#define WHEEL_ROOT_SLOTS (1 << WHEEL_ROOT_BITS)
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4                  /* Outer levels. */
+
+/* Maximum distance, in ticks, of an event from wheel_ticks.  Events
+   further away than this are parked in the last slot reachable and
+   re-filed when that slot is cascaded. */
+#define WHEEL_MAX_DISTANCE \
+  ((1LL << (WHEEL_ROOT_BITS + WHEEL_LEVELS * WHEEL_BITS)) - 1)
+
+static struct list wheel_root[WHEEL_ROOT_SLOTS];
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+/* Next tick for which the wheel has not yet expired events.
+   Trails ticks by at most one tick in timer_interrupt(). */
+static int64_t wheel_ticks;
+
+/* Tickless idle.
+
+   When timer_tickless is set and the idle thread is about to
+   halt, timer_idle_enter() reprograms the PIT in one-shot mode
+   to interrupt on the tick boundary of the next timer event,
+   instead of on every tick.  Tick boundaries keep their phase,
+   so timer_ticks() does not drift: the skipped ticks are added
+   back when the one-shot interrupt arrives, or by
+   timer_intr_enter() if some other interrupt wakes the CPU
+   first, so that a thread it wakes sees an up-to-date tick
+   count and is preempted on time. */
+bool timer_tickless;
+
+/* PIT cycles per timer tick. */
+#define PIT_CYCLES_PER_TICK ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* True while the PIT is in one-shot mode. */
+static bool oneshot_armed;
+
+/* Number of ticks, counting the one on which the one-shot interrupt
+   will arrive, that the armed one-shot covers. */
+static int64_t oneshot_ticks;
+
 /* Number of loops per timer tick.
    Initialised by timer_calibrate(). */
 static unsigned loops_per_tick;
@@ -29,17 +83,39 @@ static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
-static bool less_wake(const struct list_elem *a, const struct list_elem *b,
-    void *aux UNUSED);
+static void wheel_add (struct timer_event *);
+static int wheel_cascade (int level);
+static void wheel_run (void);
+static void timer_sleep_wake (void *t_);
+static int64_t wheel_idle_ticks (int64_t max_ticks);
+static void oneshot_disarm (void);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void)
 {
-  list_init(&timer_waiting_threads);
-  pit_configure_channel (0, 2, TIMER_FREQ);
-  intr_register_ext (0x20, timer_interrupt, "8254 Timer");
+  int level, slot;
+
+  for (slot = 0; slot < WHEEL_ROOT_SLOTS; slot++) {
+    list_init(&wheel_root[slot]);
+  }
+  for (level = 0; level < WHEEL_LEVELS; level++) {
+    for (slot = 0; slot < WHEEL_SLOTS; slot++) {
+      list_init(&wheel[level][slot]);
+    }
+  }
+  wheel_ticks = 0;
+
+  /* With the APICs in charge the tick comes from the local APIC
+     timer, on the vector the PIT would have used. */
+  if (apic_is_active ()) {
+    apic_timer_start (TIMER_FREQ);
+    intr_register_ext (0x20, timer_interrupt, "Local APIC Timer");
+  } else {
+    pit_configure_channel (0, 2, TIMER_FREQ);
+    intr_register_ext (0x20, timer_interrupt, "8254 Timer");
+  }
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -87,20 +163,6 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
-/* Returns true if ticks_to_wake_on of thread a is less than ticks_to_wake_on
-   of thread b. */
-static bool
-less_wake(const struct list_elem *a, const struct list_elem *b,
-            void *aux UNUSED) {
-
-  struct thread* thread_to_insert = list_entry(a, struct thread, sleep_elem);
-  int64_t ticks_to_insert =  thread_to_insert->ticks_to_wake_on;
-  struct thread* thread_in_list = list_entry(b, struct thread, sleep_elem);
-  int64_t ticks_in_list =  thread_in_list->ticks_to_wake_on;
-
-  return ticks_to_insert < ticks_in_list;
-}
-
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
@@ -120,10 +182,11 @@ timer_sleep (int64_t ticks)
   int64_t ticks_to_wake_on = ticks + timer_ticks();
   struct thread* cur = thread_current();
   cur->ticks_to_wake_on = ticks_to_wake_on;
+  trace_event (TRACE_SLEEP, cur->tid, ticks, 0);
 
-  /* Insert the thread into a list of sleeping threads. */
-  list_insert_ordered(&timer_waiting_threads,
-      &cur->sleep_elem, less_wake, NULL);
+  /* Schedule a timer event that will wake the thread. */
+  timer_event_init(&cur->sleep_event, timer_sleep_wake, cur);
+  timer_event_schedule(&cur->sleep_event, ticks_to_wake_on);
   intr_set_level (old_level);
 
   /* Causes the thread to wait until sema_up is called in timer_interrupt when
@@ -131,6 +194,15 @@ timer_sleep (int64_t ticks)
   sema_down(&cur->timer_wait_sema);
 }
 
+/* Timer event function for timer_sleep(). Wakes up the sleeping
+   thread T_. */
+static void
+timer_sleep_wake (void *t_)
+{
+  struct thread *t = t_;
+  sema_up(&t->timer_wait_sema);
+}
+
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
    turned on. */
 void
@@ -201,35 +273,301 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
-/* Timer interrupt handler. */
+/* Initializes timer event EV to call FUNC (AUX) when it expires.
+   EV must not be pending. */
+void
+timer_event_init (struct timer_event *ev, timer_event_func *func, void *aux)
+{
+  ASSERT (ev != NULL);
+  ASSERT (func != NULL);
+
+  ev->func = func;
+  ev->aux = aux;
+  ev->expires = 0;
+  ev->pending = false;
+}
+
+/* Schedules EV to expire on tick EXPIRES, as returned by
+   timer_ticks().  If EXPIRES has already passed, EV expires on
+   the next timer tick.  If EV is already pending, it is
+   rescheduled.
+
+   This function may be called from an interrupt handler. */
+void
+timer_event_schedule (struct timer_event *ev, int64_t expires)
+{
+  enum intr_level old_level;
+
+  ASSERT (ev != NULL);
+
+  old_level = intr_disable ();
+  if (ev->pending) {
+    list_remove(&ev->elem);
+  }
+  ev->expires = expires;
+  ev->pending = true;
+  wheel_add(ev);
+  intr_set_level (old_level);
+}
+
+/* Cancels EV.  Returns true if EV was pending, false if it had
+   already expired or was never scheduled.
+
+   This function may be called from an interrupt handler. */
+bool
+timer_event_cancel (struct timer_event *ev)
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (ev != NULL);
+
+  old_level = intr_disable ();
+  was_pending = ev->pending;
+  if (was_pending) {
+    list_remove(&ev->elem);
+    ev->pending = false;
+  }
+  intr_set_level (old_level);
+
+  return was_pending;
+}
+
+/* Files EV into the innermost wheel level whose range covers
+   its expiry tick.  Interrupts must be off. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+wheel_add (struct timer_event *ev)
 {
-  ticks++;
-  thread_tick ();
+  int64_t expires = ev->expires;
+  int64_t distance = expires - wheel_ticks;
+  struct list *slot;
+  int level;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (distance < 0) {
+    /* Already due: expire on the next tick processed. */
+    slot = &wheel_root[wheel_ticks & (WHEEL_ROOT_SLOTS - 1)];
+  } else if (distance < WHEEL_ROOT_SLOTS) {
+    slot = &wheel_root[expires & (WHEEL_ROOT_SLOTS - 1)];
+  } else {
+    if (distance > WHEEL_MAX_DISTANCE) {
+      expires = wheel_ticks + WHEEL_MAX_DISTANCE;
+      distance = WHEEL_MAX_DISTANCE;
+    }
+    for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+      if (distance < 1LL << (WHEEL_ROOT_BITS + (level + 1) * WHEEL_BITS)) {
+        break;
+      }
+    }
+    slot = &wheel[level][(expires >> (WHEEL_ROOT_BITS + level * WHEEL_BITS))
+                         & (WHEEL_SLOTS - 1)];
+  }
+
+  list_push_back(slot, &ev->elem);
+}
 
-  struct list_elem *e;
+/* Moves every event in the current slot of outer LEVEL into the
+   levels below it.  Returns the index of that slot, which is 0
+   when LEVEL has itself wrapped around and the level above must
+   be cascaded too. */
+static int
+wheel_cascade (int level)
+{
+  int index = (wheel_ticks >> (WHEEL_ROOT_BITS + level * WHEEL_BITS))
+              & (WHEEL_SLOTS - 1);
+  struct list *slot = &wheel[level][index];
+
+  while (!list_empty(slot)) {
+    struct timer_event *ev = list_entry(list_pop_front(slot),
+                                        struct timer_event, elem);
+    wheel_add(ev);
+  }
 
-  /* Traverse the list from the beginning of the list. */
-  for (e = list_begin (&timer_waiting_threads);
-		  e != list_end (&timer_waiting_threads); e = list_next (e)) {
+  return index;
+}
 
-      struct thread *waiting_thread =
-        list_entry (e, struct thread, sleep_elem);
+/* Expires all events due up to and including the current tick.
+   Only the innermost slot for each elapsed tick is examined.
+   Runs in the timer interrupt handler. */
+static void
+wheel_run (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (wheel_ticks <= ticks) {
+    int index = wheel_ticks & (WHEEL_ROOT_SLOTS - 1);
+    int level;
 
-      /* Since the list is ordered, if we find a thread that isn't due to wake
-         up, we can stop looking at threads further on in the list. */
-      if (waiting_thread->ticks_to_wake_on > timer_ticks()) {
+    /* The innermost level has wrapped around, so pull the next
+       slots of the outer levels down into it. */
+    if (index == 0) {
+      for (level = 0; level < WHEEL_LEVELS; level++) {
+        if (wheel_cascade(level) != 0) {
           break;
+        }
       }
+    }
 
-      /* Removes the thread that is due to wake up (Traversal of list would
-         have stopped if this thread was not due to wake up). */
-      list_remove(e);
+    struct list *slot = &wheel_root[index];
+    wheel_ticks++;
 
-      /* Wakes up the sleeping thread.*/
-      sema_up(&waiting_thread->timer_wait_sema);
+    while (!list_empty(slot)) {
+      struct timer_event *ev = list_entry(list_pop_front(slot),
+                                          struct timer_event, elem);
+      ev->pending = false;
+      ev->func(ev->aux);
+    }
+  }
+}
+
+/* Ticks that can pass, counting from the current one, before the
+   wheel next needs attention: either an event expires or the
+   innermost level wraps and outer levels must be cascaded.  At
+   most MAX_TICKS.  Interrupts must be off. */
+static int64_t
+wheel_idle_ticks (int64_t max_ticks)
+{
+  int64_t n;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Every event in an innermost slot expires on the next tick
+     with that slot's index, so the first non-empty slot gives the
+     next expiry. */
+  for (n = 1; n < max_ticks; n++) {
+    int index = (ticks + n) & (WHEEL_ROOT_SLOTS - 1);
+    if (index == 0 || !list_empty(&wheel_root[index])) {
+      break;
+    }
+  }
+
+  return n;
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  In tickless mode, stops the periodic timer
+   interrupt until the next tick on which there is work to do. */
+void
+timer_idle_enter (void)
+{
+  unsigned remaining, count;
+  int64_t n, max_ticks;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* One-shot programming is only implemented for the PIT. */
+  if (!timer_tickless || oneshot_armed || apic_is_active ()) {
+    return;
+  }
+
+  /* The periodic counter holds the cycles left until the next tick.
+     Each further tick skipped adds a whole period; the PIT counter
+     is only 16 bits wide.  If the counter has only just reloaded,
+     that tick's interrupt may still be pending, and would be taken
+     for the one-shot, so keep ticking. */
+  remaining = pit_read_count(0, NULL);
+  if (remaining == 0
+      || remaining + PIT_CYCLES_PER_TICK / 16 > PIT_CYCLES_PER_TICK) {
+    return;
+  }
+  max_ticks = (0xffff - remaining) / PIT_CYCLES_PER_TICK + 1;
+
+  /* The mlfqs statistics are updated by thread_tick() once a second,
+     so don't skip past the next whole second. */
+  if (thread_mlfqs) {
+    int64_t to_second = TIMER_FREQ - ticks % TIMER_FREQ;
+    if (to_second < max_ticks) {
+      max_ticks = to_second;
+    }
+  }
+
+  n = wheel_idle_ticks(max_ticks);
+  if (n < 2) {
+    /* Nothing to gain over the periodic tick. */
+    return;
   }
+
+  count = remaining + (n - 1) * PIT_CYCLES_PER_TICK;
+  pit_configure_oneshot(0, count);
+  oneshot_armed = true;
+  oneshot_ticks = n;
+}
+
+/* Called by intr_handler() on entry to every external interrupt.
+   If the CPU halted with the one-shot armed and this is some other
+   interrupt, brings ticks up to date and re-arms the one-shot for
+   the next tick boundary, after which the periodic tick resumes.
+   Only the first interrupt after the halt has anything to do. */
+void
+timer_intr_enter (void)
+{
+  unsigned count, remaining;
+  int64_t upcoming, elapsed;
+  bool expired;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!oneshot_armed || oneshot_ticks == 1) {
+    return;
+  }
+
+  count = pit_read_count(0, &expired);
+  if (expired) {
+    /* The one-shot interrupt is pending; timer_interrupt() will
+       catch up. */
+    return;
+  }
+
+  /* Tick boundaries fall where the counter reaches a multiple of
+     PIT_CYCLES_PER_TICK.  Those still above COUNT have passed. */
+  upcoming = count / PIT_CYCLES_PER_TICK;
+  if (upcoming > oneshot_ticks - 1) {
+    upcoming = oneshot_ticks - 1;
+  }
+  elapsed = oneshot_ticks - 1 - upcoming;
+  remaining = count - upcoming * PIT_CYCLES_PER_TICK;
+  if (remaining == 0) {
+    remaining = 1;
+  }
+
+  ticks += elapsed;
+  thread_tick_idle (elapsed);
+
+  pit_configure_oneshot(0, remaining);
+  oneshot_ticks = 1;
+}
+
+/* Called on the one-shot timer interrupt.  Accounts for the ticks
+   skipped before it and restarts the periodic tick, in phase with
+   the interrupt just received. */
+static void
+oneshot_disarm (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (oneshot_armed);
+
+  pit_configure_channel (0, 2, TIMER_FREQ);
+  oneshot_armed = false;
+
+  ticks += oneshot_ticks - 1;
+  thread_tick_idle (oneshot_ticks - 1);
+}
+
+/* Timer interrupt handler. */
+static void
+timer_interrupt (struct intr_frame *args UNUSED)
+{
+  if (oneshot_armed) {
+    oneshot_disarm ();
+  }
+
+  ticks++;
+  thread_tick ();
+
+  /* Wakes up sleeping threads and runs other timer events that are
+     due on this tick. */
+  wheel_run ();
 }
 
 
@@ -9,8 +9,26 @@
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
-/* List that will hold all threads that are waiting due to timer_sleep() */
-struct list timer_waiting_threads;
+/* If true, stop the periodic timer interrupt while the CPU is
+   idle.  Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
+
+/* Function called when a timer event expires.  It runs in the
+   timer interrupt handler, with interrupts off, so it must not
+   sleep. */
+typedef void timer_event_func (void *aux);
+
+/* A one-shot kernel timer.  Lets other subsystems schedule
+   deferred work for a given tick without blocking a kernel
+   thread on it.  Owned by devices/timer.c. */
+struct timer_event
+  {
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+    int64_t expires;            /* Tick on which to call FUNC. */
+    timer_event_func *func;     /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* True while in the timer wheel. */
+  };
 
 void timer_init (void);
 void timer_calibrate (void);
@@ -31,4 +49,13 @@ void timer_ndelay (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+/* Tickless idle. */
+void timer_idle_enter (void);
+void timer_intr_enter (void);
+
+/* Deferred work. */
+void timer_event_init (struct timer_event *, timer_event_func *, void *aux);
+void timer_event_schedule (struct timer_event *, int64_t expires);
+bool timer_event_cancel (struct timer_event *);
+
 #endif /* devices/timer.h */
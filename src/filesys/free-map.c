@@ -4,6 +4,7 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/vmalloc.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
@@ -12,9 +13,13 @@ static struct bitmap *free_map;      /* Free map, one bit per sector. */
 void
 free_map_init (void) 
 {
-  free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  size_t bit_cnt = block_size (fs_device);
+  size_t buf_size = bitmap_buf_size (bit_cnt);
+  void *buf = vmalloc (buf_size);
+
+  if (buf == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  free_map = bitmap_create_in_buf (bit_cnt, buf, buf_size);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
 }
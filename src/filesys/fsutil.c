@@ -154,6 +154,14 @@ fsutil_extract (char **argv UNUSED)
   free (header);
 }
 
+/* Next sector to write on the scratch device for fsutil_append()
+   and fsutil_append_buffer(). */
+static block_sector_t append_sector;
+
+static struct block *append_begin (const char *file_name, off_t size,
+                                   void *buffer);
+static void append_end (struct block *, void *buffer);
+
 /* Copies file FILE_NAME from the file system to the scratch
    device, in ustar format.
 
@@ -165,8 +173,6 @@ fsutil_extract (char **argv UNUSED)
 void
 fsutil_append (char **argv)
 {
-  static block_sector_t sector = 0;
-
   const char *file_name = argv[1];
   void *buffer;
   struct file *src;
@@ -186,37 +192,88 @@ fsutil_append (char **argv)
     PANIC ("%s: open failed", file_name);
   size = file_length (src);
 
-  /* Open target block device. */
-  dst = block_get_role (BLOCK_SCRATCH);
-  if (dst == NULL)
-    PANIC ("couldn't open scratch device");
-  
-  /* Write ustar header to first sector. */
-  if (!ustar_make_header (file_name, USTAR_REGULAR, size, buffer))
-    PANIC ("%s: name too long for ustar format", file_name);
-  block_write (dst, sector++, buffer);
+  /* Open target block device and write ustar header. */
+  dst = append_begin (file_name, size, buffer);
 
   /* Do copy. */
   while (size > 0) 
     {
       int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-      if (sector >= block_size (dst))
+      if (append_sector >= block_size (dst))
         PANIC ("%s: out of space on scratch device", file_name);
       if (file_read (src, buffer, chunk_size) != chunk_size)
         PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
       memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-      block_write (dst, sector++, buffer);
+      block_write (dst, append_sector++, buffer);
       size -= chunk_size;
     }
-
-  /* Write ustar end-of-archive marker, which is two consecutive
-     sectors full of zeros.  Don't advance our position past
-     them, though, in case we have more files to append. */
-  memset (buffer, 0, BLOCK_SECTOR_SIZE);
-  block_write (dst, sector, buffer);
-  block_write (dst, sector, buffer + 1);
+  append_end (dst, buffer);
 
   /* Finish up. */
   file_close (src);
   free (buffer);
 }
+
+/* Copies the SIZE bytes at DATA to the scratch device, in ustar
+   format, as a file named FILE_NAME, following any files already
+   appended by fsutil_append() or this function.  Lets the kernel
+   hand data it generates to the host without staging it in the
+   file system. */
+void
+fsutil_append_buffer (const char *file_name, const void *data, off_t size)
+{
+  const uint8_t *p = data;
+  void *buffer;
+  struct block *dst;
+
+  printf ("Appending '%s' to ustar archive on scratch device...\n", file_name);
+
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    PANIC ("couldn't allocate buffer");
+  dst = append_begin (file_name, size, buffer);
+
+  while (size > 0)
+    {
+      int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
+      if (append_sector >= block_size (dst))
+        PANIC ("%s: out of space on scratch device", file_name);
+      memcpy (buffer, p, chunk_size);
+      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
+      block_write (dst, append_sector++, buffer);
+      p += chunk_size;
+      size -= chunk_size;
+    }
+  append_end (dst, buffer);
+
+  free (buffer);
+}
+
+/* Opens the scratch device and writes a ustar header for a
+   SIZE-byte file named FILE_NAME at append_sector, using BUFFER,
+   which must be BLOCK_SECTOR_SIZE bytes, as scratch space.
+   Returns the scratch device. */
+static struct block *
+append_begin (const char *file_name, off_t size, void *buffer)
+{
+  struct block *dst = block_get_role (BLOCK_SCRATCH);
+  if (dst == NULL)
+    PANIC ("couldn't open scratch device");
+
+  if (!ustar_make_header (file_name, USTAR_REGULAR, size, buffer))
+    PANIC ("%s: name too long for ustar format", file_name);
+  block_write (dst, append_sector++, buffer);
+  return dst;
+}
+
+/* Writes a ustar end-of-archive marker, which is two consecutive
+   sectors full of zeros, to DST at append_sector, using BUFFER as
+   scratch space.  Doesn't advance our position past them, though,
+   in case we have more files to append. */
+static void
+append_end (struct block *dst, void *buffer)
+{
+  memset (buffer, 0, BLOCK_SECTOR_SIZE);
+  block_write (dst, append_sector, buffer);
+  block_write (dst, append_sector, buffer + 1);
+}
@@ -0,0 +1,217 @@
+/* Pairing heap.
+
+   See heap.h for basic information.  A pairing heap is a
+   heap-ordered multiway tree, stored as first-child,
+   next-sibling binary tree.  Two heaps are melded by making the
+   root with the lesser key the first child of the other.  Removing
+   the root melds its children in pairs from left to right, then
+   melds the results together from right to left.  See Fredman,
+   Sedgewick, Sleator, and Tarjan, "The pairing heap: A new form of
+   self-adjusting heap", Algorithmica 1 (1986). */
+
+#include "heap.h"
+#include "../debug.h"
+
+static bool elem_less (const struct heap *, const struct heap_elem *,
+                       const struct heap_elem *);
+static struct heap_elem *meld (const struct heap *, struct heap_elem *,
+                               struct heap_elem *);
+static struct heap_elem *meld_children (const struct heap *,
+                                        struct heap_elem *);
+static void detach (struct heap_elem *);
+
+/* Initializes H as an empty heap that orders its elements with
+   LESS, given auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->next_seq = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_insert (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  e->seq = h->next_seq++;
+  h->root = meld (h, h->root, e);
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  if (e == h->root)
+    heap_pop_max (h);
+  else
+    {
+      detach (e);
+      h->root = meld (h, h->root, meld_children (h, e->child));
+    }
+}
+
+/* Restores H's ordering after the key of E, which must be in H,
+   has increased.  Keys must never decrease in place; remove and
+   reinsert the element instead. */
+void
+heap_increase (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  /* E still orders correctly against its own subtree, so cut the
+     subtree out and meld it back in at the root. */
+  if (e != h->root)
+    {
+      detach (e);
+      h->root = meld (h, h->root, e);
+    }
+}
+
+/* Returns the greatest element in H, or a null pointer if H is
+   empty. */
+struct heap_elem *
+heap_max (const struct heap *h)
+{
+  ASSERT (h != NULL);
+  return h->root;
+}
+
+/* Removes and returns the greatest element in H, or returns a
+   null pointer if H is empty. */
+struct heap_elem *
+heap_pop_max (struct heap *h)
+{
+  struct heap_elem *max;
+
+  ASSERT (h != NULL);
+
+  max = h->root;
+  if (max != NULL)
+    h->root = meld_children (h, max->child);
+  return max;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (const struct heap *h)
+{
+  ASSERT (h != NULL);
+  return h->root == NULL;
+}
+
+/* Returns true if A should leave H after B: A is less than B, or
+   they are equal and A was inserted later. */
+static bool
+elem_less (const struct heap *h, const struct heap_elem *a,
+           const struct heap_elem *b)
+{
+  if (h->less (a, b, h->aux))
+    return true;
+  if (h->less (b, a, h->aux))
+    return false;
+  return (int) (a->seq - b->seq) > 0;
+}
+
+/* Melds the heaps rooted at A and B, either of which may be null,
+   neither of which may have siblings, and returns the new root. */
+static struct heap_elem *
+meld (const struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  struct heap_elem *tmp;
+
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+
+  if (elem_less (h, a, b))
+    {
+      tmp = a;
+      a = b;
+      b = tmp;
+    }
+
+  /* Make B the first child of A. */
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+
+  a->next = a->prev = NULL;
+  return a;
+}
+
+/* Melds the sibling list starting at FIRST into a single heap and
+   returns its root, or a null pointer if FIRST is null. */
+static struct heap_elem *
+meld_children (const struct heap *h, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root;
+
+  /* First pass: meld siblings in pairs, left to right, pushing
+     each result onto the front of the PAIRS list so that it ends
+     up in right-to-left order. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+      struct heap_elem *pair;
+
+      first = b != NULL ? b->next : NULL;
+      a->next = a->prev = NULL;
+      if (b != NULL)
+        b->next = b->prev = NULL;
+      pair = meld (h, a, b);
+      pair->next = pairs;
+      pairs = pair;
+    }
+
+  /* Second pass: meld the pairs together, right to left. */
+  root = pairs;
+  if (root != NULL)
+    {
+      struct heap_elem *rest = root->next;
+
+      root->next = NULL;
+      while (rest != NULL)
+        {
+          struct heap_elem *pair = rest;
+
+          rest = pair->next;
+          pair->next = NULL;
+          root = meld (h, root, pair);
+        }
+    }
+  return root;
+}
+
+/* Cuts E, which must not be a root, and its subtree out of its
+   parent's list of children. */
+static void
+detach (struct heap_elem *e)
+{
+  ASSERT (e->prev != NULL);
+
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  e->next = e->prev = NULL;
+}
@@ -0,0 +1,71 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue, implemented as a pairing heap.
+
+   Insertion takes O(1) time, finding the greatest element takes
+   O(1) time, and removing it, or any other element, takes
+   O(log n) amortized time.  Increasing an element's key in place
+   takes O(1) time, with the cost deferred to later removals.
+
+   Like the linked list and hash table implementations, this does
+   not require dynamic allocation.  Each structure that can be in
+   a heap must embed a struct heap_elem member, and the
+   heap_entry macro converts from a struct heap_elem back to the
+   structure containing it.  Refer to lib/kernel/list.h for a
+   detailed explanation of the technique.
+
+   Elements are ordered by a caller-supplied "less" function.
+   Elements that compare equal leave the heap in the order in
+   which they were inserted. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* First (leftmost) child. */
+    struct heap_elem *next;     /* Next sibling. */
+    struct heap_elem *prev;     /* Previous sibling, or parent if this
+                                   is its first child. */
+    unsigned seq;               /* Insertion order, to break ties. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)                   \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child            \
+                     - offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Greatest element, or NULL. */
+    unsigned next_seq;          /* Sequence number for next insertion. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_insert (struct heap *, struct heap_elem *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_increase (struct heap *, struct heap_elem *);
+
+struct heap_elem *heap_max (const struct heap *);
+struct heap_elem *heap_pop_max (struct heap *);
+
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -0,0 +1,73 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A balanced binary search tree: insertion, removal, and lookup
+   all take O(log n) time.  The tree also remembers its minimum
+   element, so that finding it takes O(1) time, which suits its
+   use as a priority queue (see the CFS run queue in
+   threads/thread.c).
+
+   Like the linked list and hash table implementations, this does
+   not require dynamic allocation.  Each structure that can be in
+   a tree must embed a struct rb_elem member, and the rb_entry
+   macro converts from a struct rb_elem back to the structure
+   containing it.  Refer to lib/kernel/list.h for a detailed
+   explanation of the technique.
+
+   Elements are ordered by a caller-supplied "less" function.
+   Elements that compare equal are allowed; a newly inserted
+   element goes after all elements equal to it, so equal
+   elements leave the tree in FIFO order through rb_min(). */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rb_elem
+  {
+    struct rb_elem *parent;     /* Parent, or NULL at the root. */
+    struct rb_elem *left;       /* Left child, or NULL. */
+    struct rb_elem *right;      /* Right child, or NULL. */
+    bool red;                   /* Red or black node? */
+  };
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+   structure that RB_ELEM is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)                       \
+        ((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent             \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+                           const struct rb_elem *b,
+                           void *aux);
+
+/* Red-black tree. */
+struct rb_tree
+  {
+    struct rb_elem *root;       /* Root, or NULL if empty. */
+    struct rb_elem *min;        /* Leftmost element, or NULL if empty. */
+    size_t elem_cnt;            /* Number of elements in tree. */
+    rb_less_func *less;         /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void rb_init (struct rb_tree *, rb_less_func *, void *aux);
+
+void rb_insert (struct rb_tree *, struct rb_elem *);
+void rb_remove (struct rb_tree *, struct rb_elem *);
+
+struct rb_elem *rb_min (const struct rb_tree *);
+struct rb_elem *rb_next (struct rb_elem *);
+
+size_t rb_size (const struct rb_tree *);
+bool rb_empty (const struct rb_tree *);
+
+#endif /* lib/kernel/rbtree.h */
@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-sema-trace) begin
+(priority-sema-trace) Thread priority 30 woke up.
+(priority-sema-trace) Back in main thread.
+(priority-sema-trace) Thread priority 29 woke up.
+(priority-sema-trace) Back in main thread.
+(priority-sema-trace) Thread priority 28 woke up.
+(priority-sema-trace) Back in main thread.
+(priority-sema-trace) Thread priority 27 woke up.
+(priority-sema-trace) Back in main thread.
+(priority-sema-trace) Thread priority 26 woke up.
+(priority-sema-trace) Back in main thread.
+(priority-sema-trace) Thread priority 25 woke up.
+(priority-sema-trace) Back in main thread.
+(priority-sema-trace) Thread priority 24 woke up.
+(priority-sema-trace) Back in main thread.
+(priority-sema-trace) Thread priority 23 woke up.
+(priority-sema-trace) Back in main thread.
+(priority-sema-trace) Thread priority 22 woke up.
+(priority-sema-trace) Back in main thread.
+(priority-sema-trace) Thread priority 21 woke up.
+(priority-sema-trace) Back in main thread.
+(priority-sema-trace) end
+EOF
+pass;
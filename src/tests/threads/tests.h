@@ -26,6 +26,7 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_mem_bench;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
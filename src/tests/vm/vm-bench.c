@@ -0,0 +1,70 @@
+/* Benchmarks the eviction policies.  Repeatedly writes to a hot
+   working set in memory, interleaved with sequential reads of
+   the next window of a memory-mapped file.  Each window, together
+   with the working set, is larger than the user pool of a 4 MB
+   machine.  A policy that resists scans keeps the working set
+   resident while the file streams through.
+
+   Not a graded test.  Run it once for each policy, e.g.
+     pintos -v -k --filesys-size=4 --swap-size=4 -p build/tests/vm/vm-bench \
+       -a vm-bench -- -q -f -evict=arc run vm-bench
+   and compare the "Exception: N page faults" lines printed at
+   shutdown, which count the page faults taken under that policy. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define HOT_PAGES 256                   /* Pages in the working set. */
+#define SCAN_PAGES 512                  /* Pages in the scanned file. */
+#define WINDOW_PAGES 128                /* Pages scanned per round. */
+#define ROUNDS 8                        /* Windows scanned. */
+#define HOT_PASSES 4                    /* Passes over the working set
+                                           between scans. */
+
+static char hot[HOT_PAGES * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  char *scan = (char *) 0x10000000;
+  const char *file_name = "vm-bench.dat";
+  unsigned sum = 0;
+  int handle;
+  mapid_t map;
+  int round, pass;
+  size_t i;
+
+  CHECK (create (file_name, SCAN_PAGES * PAGE_SIZE),
+         "create \"%s\"", file_name);
+  CHECK ((handle = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK ((map = mmap (handle, scan)) != MAP_FAILED, "mmap \"%s\"", file_name);
+
+  msg ("%d rounds: %d pages hot, %d pages scanned per round",
+       ROUNDS, HOT_PAGES, WINDOW_PAGES);
+  for (round = 0; round < ROUNDS; round++)
+    {
+      for (pass = 0; pass < HOT_PASSES; pass++)
+        for (i = 0; i < HOT_PAGES; i++)
+          hot[i * PAGE_SIZE + round]++;
+      for (i = 0; i < WINDOW_PAGES; i++)
+        sum += scan[(round * WINDOW_PAGES + i) % SCAN_PAGES * PAGE_SIZE];
+    }
+
+  /* The file is all zeros, and each byte of the working set
+     written was incremented once per pass. */
+  if (sum != 0)
+    fail ("scan read %u, expected 0", sum);
+  for (round = 0; round < ROUNDS; round++)
+    for (i = 0; i < HOT_PAGES; i++)
+      if (hot[i * PAGE_SIZE + round] != HOT_PASSES)
+        fail ("byte %zu of working set is %d, expected %d",
+              i * PAGE_SIZE + round, hot[i * PAGE_SIZE + round], HOT_PASSES);
+
+  munmap (map);
+  close (handle);
+  remove (file_name);
+  msg ("done");
+}
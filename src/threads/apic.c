@@ -0,0 +1,277 @@
+#include "threads/apic.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/pit.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Advanced Programmable Interrupt Controller (APIC) support.
+
+   When enabled with the "-apic" kernel command-line option, and
+   the MP configuration table (see cpu.c) describes a local APIC
+   and an I/O APIC, this replaces the 8259A PICs: external
+   interrupts are routed through the I/O APIC to the boot CPU's
+   local APIC and acknowledged with a single memory-mapped write
+   to the local APIC instead of port I/O to the PICs, and the
+   timer tick comes from the local APIC timer, calibrated against
+   the PIT, instead of from the PIT.
+
+   ISA IRQ N is still delivered on vector 0x20 + N, so interrupt
+   handlers are registered the same way with either controller.
+   The local APIC timer also uses vector 0x20, taking the place of
+   the PIT's IRQ 0, which is left masked.
+
+   See [IA32-v3a] chapter 8 "Advanced Programmable Interrupt
+   Controller (APIC)" and the 82093AA I/O APIC datasheet. */
+
+/* Kernel virtual addresses at which the APICs' registers are
+   mapped.  They sit in the top page directory entry, far above
+   the kernel's mapping of physical memory. */
+#define LAPIC_VADDR ((void *) 0xfffff000)
+#define IOAPIC_VADDR ((void *) 0xffffe000)
+
+/* Local APIC registers, as offsets from its base. */
+#define LAPIC_ID          0x020         /* Local APIC ID. */
+#define LAPIC_TPR         0x080         /* Task priority. */
+#define LAPIC_EOI         0x0b0         /* End of interrupt. */
+#define LAPIC_SVR         0x0f0         /* Spurious interrupt vector. */
+#define LAPIC_LVT_TIMER   0x320         /* Local vector table: timer. */
+#define LAPIC_LVT_LINT0   0x350         /* Local vector table: LINT0. */
+#define LAPIC_LVT_LINT1   0x360         /* Local vector table: LINT1. */
+#define LAPIC_TIMER_INIT  0x380         /* Timer initial count. */
+#define LAPIC_TIMER_CUR   0x390         /* Timer current count. */
+#define LAPIC_TIMER_DIV   0x3e0         /* Timer divide configuration. */
+
+#define LAPIC_SVR_ENABLE     0x100      /* APIC software enable. */
+#define LAPIC_LVT_MASKED     0x10000    /* Interrupt masked. */
+#define LAPIC_LVT_NMI        0x400      /* Delivery mode NMI. */
+#define LAPIC_TIMER_PERIODIC 0x20000    /* Timer mode periodic. */
+#define LAPIC_TIMER_DIV_16   0x3        /* Divide bus clock by 16. */
+
+/* I/O APIC registers, accessed indirectly through IOREGSEL and
+   IOWIN. */
+#define IOAPIC_IOREGSEL   0x00          /* Register select. */
+#define IOAPIC_IOWIN      0x10          /* Register data window. */
+#define IOAPIC_VER        0x01          /* Version, max redirection entry. */
+#define IOAPIC_REDTBL(N)  (0x10 + 2 * (N))  /* Redirection entry N. */
+
+#define IOAPIC_ACTIVE_LOW 0x2000        /* Redirection: polarity low. */
+#define IOAPIC_LEVEL      0x8000        /* Redirection: level triggered. */
+#define IOAPIC_MASKED     0x10000       /* Redirection: masked. */
+
+/* Model-specific register holding the local APIC base and the
+   global enable bit.  See [IA32-v3a] 8.4.4. */
+#define MSR_APIC_BASE 0x1b
+#define MSR_APIC_BASE_ENABLE 0x800
+
+/* Vector for spurious local APIC interrupts, which need no EOI. */
+#define SPURIOUS_VECTOR 0xff
+
+/* PIT cycles over which to calibrate the local APIC timer (10 ms). */
+#define CALIBRATE_PIT_CYCLES (PIT_HZ / 100)
+
+/* True once the APICs have replaced the PICs. */
+static bool active;
+
+static void map_mmio (void *vaddr, uint32_t paddr);
+static bool cpu_has_apic (void);
+static void spurious_interrupt (struct intr_frame *);
+
+/* Reads local APIC register REG. */
+static inline uint32_t
+lapic_read (uint32_t reg)
+{
+  return *(volatile uint32_t *) ((uint8_t *) LAPIC_VADDR + reg);
+}
+
+/* Writes VALUE to local APIC register REG. */
+static inline void
+lapic_write (uint32_t reg, uint32_t value)
+{
+  *(volatile uint32_t *) ((uint8_t *) LAPIC_VADDR + reg) = value;
+}
+
+/* Reads I/O APIC register REG. */
+static inline uint32_t
+ioapic_read (uint32_t reg)
+{
+  volatile uint32_t *base = IOAPIC_VADDR;
+  base[IOAPIC_IOREGSEL / 4] = reg;
+  return base[IOAPIC_IOWIN / 4];
+}
+
+/* Writes VALUE to I/O APIC register REG. */
+static inline void
+ioapic_write (uint32_t reg, uint32_t value)
+{
+  volatile uint32_t *base = IOAPIC_VADDR;
+  base[IOAPIC_IOREGSEL / 4] = reg;
+  base[IOAPIC_IOWIN / 4] = value;
+}
+
+/* Switches interrupt delivery from the PICs, which must already
+   have been initialized by pic_init(), to the APICs.  Returns
+   true if successful, false if the machine has no usable APICs,
+   in which case the PICs stay in charge.  Must be called with
+   interrupts off, after paging_init(). */
+bool
+apic_init (void)
+{
+  uint32_t lo, hi;
+  int irq, max_entry;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (mp_lapic_paddr == 0 || mp_ioapic_paddr == 0 || !cpu_has_apic ())
+    {
+      printf ("No APIC found, using 8259A PIC.\n");
+      return false;
+    }
+
+  map_mmio (LAPIC_VADDR, mp_lapic_paddr);
+  map_mmio (IOAPIC_VADDR, mp_ioapic_paddr);
+
+  /* Mask everything on the PICs.  They keep the vectors pic_init()
+     gave them, so a spurious PIC interrupt is still recognizable. */
+  outb (0x21, 0xff);
+  outb (0xa1, 0xff);
+
+  /* In PIC mode, connect the interrupt lines to the APICs through
+     the IMCR.  See [MP] 3.6.2.1. */
+  if (mp_imcr_present)
+    {
+      outb (0x22, 0x70);
+      outb (0x23, 0x01);
+    }
+
+  /* Globally enable the local APIC, then software-enable it with
+     the spurious vector, accept all priorities, and leave LINT0
+     (ExtINT from the PIC) masked and LINT1 as NMI. */
+  asm volatile ("rdmsr" : "=a" (lo), "=d" (hi) : "c" (MSR_APIC_BASE));
+  lo |= MSR_APIC_BASE_ENABLE;
+  asm volatile ("wrmsr" : : "a" (lo), "d" (hi), "c" (MSR_APIC_BASE));
+  lapic_write (LAPIC_SVR, LAPIC_SVR_ENABLE | SPURIOUS_VECTOR);
+  lapic_write (LAPIC_TPR, 0);
+  lapic_write (LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+  lapic_write (LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+  lapic_write (LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+  intr_register_int (SPURIOUS_VECTOR, 0, INTR_OFF, spurious_interrupt,
+                     "APIC Spurious");
+
+  /* Mask every I/O APIC input, then route ISA IRQs 1...15 to the
+     boot CPU on vectors 0x21...0x2f.  IRQ 0, the PIT, stays masked
+     because the local APIC timer provides the tick.  IRQ 2 is the
+     PIC cascade and never fires. */
+  max_entry = (ioapic_read (IOAPIC_VER) >> 16) & 0xff;
+  for (irq = 0; irq <= max_entry; irq++)
+    ioapic_write (IOAPIC_REDTBL (irq), IOAPIC_MASKED);
+  for (irq = 1; irq < 16; irq++)
+    {
+      const struct mp_isa_irq *route = &mp_isa_irqs[irq];
+      uint32_t entry = 0x20 + irq;
+
+      if (irq == 2 || route->pin > max_entry)
+        continue;
+      if (route->active_low)
+        entry |= IOAPIC_ACTIVE_LOW;
+      if (route->level_triggered)
+        entry |= IOAPIC_LEVEL;
+      ioapic_write (IOAPIC_REDTBL (route->pin) + 1,
+                    (uint32_t) cpu_boot ()->lapic_id << 24);
+      ioapic_write (IOAPIC_REDTBL (route->pin), entry);
+    }
+
+  active = true;
+  printf ("Using local APIC and I/O APIC.\n");
+  return true;
+}
+
+/* Returns true if the APICs have replaced the PICs. */
+bool
+apic_is_active (void)
+{
+  return active;
+}
+
+/* Signals end of interrupt to the local APIC.  Unlike the PICs,
+   the local APIC does not care which vector is being
+   acknowledged. */
+void
+apic_end_of_interrupt (void)
+{
+  ASSERT (active);
+  lapic_write (LAPIC_EOI, 0);
+}
+
+/* Starts the local APIC timer interrupting FREQUENCY times per
+   second on vector 0x20.  Its rate depends on the bus clock, so
+   it is first measured against the PIT, which is programmed in
+   one-shot mode and polled, with its own interrupt masked. */
+void
+apic_timer_start (int frequency)
+{
+  uint32_t elapsed, count;
+  enum intr_level old_level;
+  bool done;
+
+  ASSERT (active);
+  ASSERT (frequency > 0);
+
+  old_level = intr_disable ();
+  lapic_write (LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+  lapic_write (LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+
+  pit_configure_oneshot (0, CALIBRATE_PIT_CYCLES);
+  lapic_write (LAPIC_TIMER_INIT, 0xffffffff);
+  do
+    pit_read_count (0, &done);
+  while (!done);
+  elapsed = 0xffffffff - lapic_read (LAPIC_TIMER_CUR);
+
+  count = (uint64_t) elapsed * PIT_HZ / CALIBRATE_PIT_CYCLES / frequency;
+  if (count == 0)
+    count = 1;
+  lapic_write (LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | 0x20);
+  lapic_write (LAPIC_TIMER_INIT, count);
+  intr_set_level (old_level);
+}
+
+/* Maps the page of device registers at physical address PADDR at
+   kernel virtual address VADDR in init_page_dir, uncached. */
+static void
+map_mmio (void *vaddr, uint32_t paddr)
+{
+  uint32_t *pde = init_page_dir + pd_no (vaddr);
+  uint32_t *pt;
+
+  ASSERT (pg_ofs (vaddr) == 0);
+
+  if (*pde == 0)
+    *pde = pde_create (palloc_get_page (PAL_ASSERT | PAL_ZERO));
+  pt = pde_get_pt (*pde);
+  pt[pt_no (vaddr)] = (paddr & PTE_ADDR) | PTE_P | PTE_W | PTE_PCD | PTE_PWT;
+  asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+}
+
+/* Returns true if CPUID reports an on-chip local APIC. */
+static bool
+cpu_has_apic (void)
+{
+  uint32_t a, b, c, d;
+
+  asm volatile ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (1));
+  return (d & (1 << 9)) != 0;
+}
+
+/* Spurious local APIC interrupts need neither handling nor an
+   EOI. */
+static void
+spurious_interrupt (struct intr_frame *f UNUSED)
+{
+}
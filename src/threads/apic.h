@@ -0,0 +1,11 @@
+#ifndef THREADS_APIC_H
+#define THREADS_APIC_H
+
+#include <stdbool.h>
+
+bool apic_init (void);
+bool apic_is_active (void);
+void apic_end_of_interrupt (void);
+void apic_timer_start (int frequency);
+
+#endif /* threads/apic.h */
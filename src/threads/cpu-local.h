@@ -0,0 +1,14 @@
+#ifndef THREADS_CPU_LOCAL_H
+#define THREADS_CPU_LOCAL_H
+
+/* Just enough of threads/cpu.h for low-level code, such as
+   malloc(), that keeps per-CPU data in arrays indexed by CPU
+   number but can't include threads/cpu.h, which pulls in most
+   of the kernel through threads/thread.h. */
+
+/* Maximum number of CPUs supported. */
+#define CPU_MAX 16
+
+unsigned cpu_current_id (void);
+
+#endif /* threads/cpu-local.h */
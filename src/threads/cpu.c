@@ -0,0 +1,340 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <packed.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/vaddr.h"
+
+/* CPU and interrupt controller discovery.
+
+   CPUs are found by reading the configuration table of the Intel
+   MultiProcessor Specification (see [MP] chapter 4), which the
+   BIOS provides when the machine has more than one CPU, e.g.
+   QEMU with "-smp N".  Without one we assume a single CPU.  The
+   same table describes the local and I/O APICs and how ISA IRQs
+   are wired to the I/O APIC, which threads/apic.c uses.
+
+   Only the boot CPU runs threads.  The others are recorded in
+   cpus[] but left halted by the BIOS: starting them would need
+   a real-mode trampoline, per-CPU GDTs and TSSs, and locking
+   that does not rely on turning interrupts off. */
+
+struct cpu cpus[CPU_MAX];
+unsigned cpu_cnt;
+
+uint32_t mp_lapic_paddr;
+uint32_t mp_ioapic_paddr;
+uint8_t mp_ioapic_id;
+bool mp_imcr_present;
+struct mp_isa_irq mp_isa_irqs[16];
+
+/* MP floating pointer structure.  See [MP] 4.1. */
+struct mp_fps
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config_paddr;      /* Physical address of config table. */
+    uint8_t length;             /* Length in 16-byte units. */
+    uint8_t spec_rev;           /* Version of the spec. */
+    uint8_t checksum;           /* All bytes sum to 0. */
+    uint8_t features[5];        /* Default configuration, if nonzero. */
+  } PACKED;
+
+/* MP configuration table header.  See [MP] 4.2. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Base table length, with header. */
+    uint8_t spec_rev;           /* Version of the spec. */
+    uint8_t checksum;           /* All bytes sum to 0. */
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table_paddr;
+    uint16_t oem_table_size;
+    uint16_t entry_cnt;         /* Entries following the header. */
+    uint32_t lapic_paddr;       /* Local APIC registers. */
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+  } PACKED;
+
+/* MP configuration table entry types.  See [MP] 4.3. */
+enum mp_entry_type
+  {
+    MP_PROCESSOR = 0,           /* 20 bytes. */
+    MP_BUS = 1,                 /* 8 bytes. */
+    MP_IOAPIC = 2,              /* 8 bytes. */
+    MP_IO_INTERRUPT = 3,        /* 8 bytes. */
+    MP_LOCAL_INTERRUPT = 4      /* 8 bytes. */
+  };
+
+/* MP processor entry.  See [MP] 4.3.1. */
+struct mp_processor
+  {
+    uint8_t type;               /* MP_PROCESSOR. */
+    uint8_t lapic_id;           /* Local APIC ID. */
+    uint8_t lapic_version;
+    uint8_t flags;              /* MP_CPU_* flags. */
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+  } PACKED;
+
+#define MP_CPU_ENABLED 0x01     /* Processor usable. */
+#define MP_CPU_BSP 0x02         /* Boot processor. */
+
+/* MP bus entry.  See [MP] 4.3.2. */
+struct mp_bus
+  {
+    uint8_t type;               /* MP_BUS. */
+    uint8_t bus_id;
+    char type_string[6];        /* "ISA   ", "PCI   ", ... */
+  } PACKED;
+
+/* MP I/O APIC entry.  See [MP] 4.3.3. */
+struct mp_ioapic
+  {
+    uint8_t type;               /* MP_IOAPIC. */
+    uint8_t ioapic_id;
+    uint8_t ioapic_version;
+    uint8_t flags;              /* Bit 0: usable. */
+    uint32_t paddr;             /* Registers. */
+  } PACKED;
+
+/* MP I/O interrupt assignment entry.  See [MP] 4.3.4. */
+struct mp_io_interrupt
+  {
+    uint8_t type;               /* MP_IO_INTERRUPT. */
+    uint8_t irq_type;           /* 0 for a vectored interrupt. */
+    uint16_t flags;             /* Polarity in bits 0-1, trigger in 2-3. */
+    uint8_t src_bus_id;
+    uint8_t src_bus_irq;
+    uint8_t dst_ioapic_id;
+    uint8_t dst_ioapic_pin;
+  } PACKED;
+
+#define MP_POLARITY_LOW 0x3     /* Active low, in flags bits 0-1. */
+#define MP_TRIGGER_LEVEL 0xc    /* Level triggered, in flags bits 2-3. */
+
+/* Bit set in the MP floating pointer's second feature byte when
+   the system boots in PIC mode.  See [MP] 3.6.2.1. */
+#define MP_FEATURE_IMCRP 0x80
+
+static void cpu_init_one (struct cpu *, unsigned id, uint8_t lapic_id);
+static struct mp_fps *mp_search (uint32_t paddr, size_t size);
+static bool mp_checksum_ok (const void *, size_t size);
+static void mp_parse (const struct mp_config *);
+static rb_less_func vruntime_less;
+
+/* Finds the CPUs in the machine and initializes cpus[].  Must be
+   called before thread_init(), which uses the boot CPU's run
+   queue. */
+void
+cpu_init (void)
+{
+  struct mp_fps *fps;
+  uint32_t ebda_paddr, basemem_paddr;
+  int i;
+
+  cpu_cnt = 0;
+  mp_lapic_paddr = 0;
+  mp_ioapic_paddr = 0;
+  for (i = 0; i < 16; i++)
+    {
+      mp_isa_irqs[i].pin = i;
+      mp_isa_irqs[i].active_low = false;
+      mp_isa_irqs[i].level_triggered = false;
+    }
+
+  /* Search, in order, the first kB of the Extended BIOS Data Area,
+     the last kB of base memory, and the BIOS ROM.  See [MP] 4. */
+  ebda_paddr = *(uint16_t *) ptov (0x40e) << 4;
+  basemem_paddr = *(uint16_t *) ptov (0x413) * 1024;
+  fps = NULL;
+  if (ebda_paddr != 0)
+    fps = mp_search (ebda_paddr, 1024);
+  if (fps == NULL && basemem_paddr >= 1024)
+    fps = mp_search (basemem_paddr - 1024, 1024);
+  if (fps == NULL)
+    fps = mp_search (0xf0000, 0x10000);
+
+  if (fps != NULL && fps->config_paddr != 0 && fps->features[0] == 0)
+    {
+      const struct mp_config *config = ptov (fps->config_paddr);
+      if (!memcmp (config->signature, "PCMP", 4)
+          && mp_checksum_ok (config, config->length))
+        {
+          mp_imcr_present = (fps->features[1] & MP_FEATURE_IMCRP) != 0;
+          mp_parse (config);
+        }
+    }
+
+  /* No usable table: this is a uniprocessor. */
+  if (cpu_cnt == 0)
+    cpu_init_one (&cpus[cpu_cnt++], 0, 0);
+
+  printf ("%u CPU%s found, using the boot CPU only.\n",
+          cpu_cnt, cpu_cnt != 1 ? "s" : "");
+}
+
+/* Returns the CPU the running thread is on.
+
+   The running thread is found from the stack pointer, as in
+   running_thread() in thread.c, rather than with
+   thread_current(), whose sanity checks fail inside schedule()
+   once the outgoing thread is no longer THREAD_RUNNING. */
+struct cpu *
+cpu_current (void)
+{
+  uint32_t *esp;
+
+  asm ("mov %%esp, %0" : "=g" (esp));
+  return ((struct thread *) pg_round_down (esp))->cpu;
+}
+
+/* Returns the index in cpus[] of the CPU the running thread is
+   on. */
+unsigned
+cpu_current_id (void)
+{
+  return cpu_current ()->id;
+}
+
+/* Returns the boot CPU. */
+struct cpu *
+cpu_boot (void)
+{
+  return &cpus[0];
+}
+
+/* Initializes C as CPU number ID, with local APIC ID LAPIC_ID and
+   an empty run queue. */
+static void
+cpu_init_one (struct cpu *c, unsigned id, uint8_t lapic_id)
+{
+  int i;
+
+  memset (c, 0, sizeof *c);
+  c->id = id;
+  c->lapic_id = lapic_id;
+  for (i = 0; i < NUM_PRIORITIES; i++)
+    list_init (&c->ready_lists[i]);
+  rb_init (&c->cfs_tree, vruntime_less, NULL);
+}
+
+/* Orders threads in a CFS run queue by virtual runtime. */
+static bool
+vruntime_less (const struct rb_elem *a_, const struct rb_elem *b_,
+               void *aux UNUSED)
+{
+  const struct thread *a = rb_entry (a_, struct thread, cfs_elem);
+  const struct thread *b = rb_entry (b_, struct thread, cfs_elem);
+
+  return a->vruntime < b->vruntime;
+}
+
+/* Looks for an MP floating pointer structure in the SIZE bytes of
+   physical memory starting at PADDR.  Returns it if found, or a
+   null pointer otherwise. */
+static struct mp_fps *
+mp_search (uint32_t paddr, size_t size)
+{
+  uint8_t *p = ptov (paddr);
+  uint8_t *end = p + size;
+
+  for (; p + sizeof (struct mp_fps) <= end; p += 16)
+    {
+      struct mp_fps *fps = (struct mp_fps *) p;
+      if (!memcmp (fps->signature, "_MP_", 4)
+          && mp_checksum_ok (fps, fps->length * 16))
+        return fps;
+    }
+  return NULL;
+}
+
+/* Returns true if the SIZE bytes at P sum to 0 modulo 256. */
+static bool
+mp_checksum_ok (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum == 0;
+}
+
+/* Records the enabled processors listed in CONFIG, putting the
+   boot processor first, the first usable I/O APIC and the routing
+   of ISA IRQs to it. */
+static void
+mp_parse (const struct mp_config *config)
+{
+  const uint8_t *p = (const uint8_t *) (config + 1);
+  const uint8_t *end = (const uint8_t *) config + config->length;
+  bool found_bsp = false;
+  uint32_t isa_buses = 0;
+  unsigned i;
+
+  mp_lapic_paddr = config->lapic_paddr;
+
+  /* Slot 0 is kept for the boot processor. */
+  cpu_cnt = 1;
+  for (i = 0; i < config->entry_cnt && p < end; i++)
+    {
+      if (*p == MP_PROCESSOR)
+        {
+          const struct mp_processor *proc = (const void *) p;
+          if (proc->flags & MP_CPU_BSP)
+            {
+              cpu_init_one (&cpus[0], 0, proc->lapic_id);
+              found_bsp = true;
+            }
+          else if ((proc->flags & MP_CPU_ENABLED) && cpu_cnt < CPU_MAX)
+            {
+              cpu_init_one (&cpus[cpu_cnt], cpu_cnt, proc->lapic_id);
+              cpu_cnt++;
+            }
+          p += sizeof *proc;
+          continue;
+        }
+
+      if (*p == MP_BUS)
+        {
+          const struct mp_bus *bus = (const void *) p;
+          if (!memcmp (bus->type_string, "ISA", 3) && bus->bus_id < 32)
+            isa_buses |= 1u << bus->bus_id;
+        }
+      else if (*p == MP_IOAPIC)
+        {
+          const struct mp_ioapic *ioapic = (const void *) p;
+          if ((ioapic->flags & 1) && mp_ioapic_paddr == 0)
+            {
+              mp_ioapic_paddr = ioapic->paddr;
+              mp_ioapic_id = ioapic->ioapic_id;
+            }
+        }
+      else if (*p == MP_IO_INTERRUPT)
+        {
+          /* Bus entries precede interrupt entries, so ISA_BUSES is
+             complete by now.  See [MP] 4.3. */
+          const struct mp_io_interrupt *intr = (const void *) p;
+          if (intr->irq_type == 0 && intr->src_bus_irq < 16
+              && intr->src_bus_id < 32
+              && (isa_buses & (1u << intr->src_bus_id))
+              && intr->dst_ioapic_id == mp_ioapic_id)
+            {
+              struct mp_isa_irq *irq = &mp_isa_irqs[intr->src_bus_irq];
+              irq->pin = intr->dst_ioapic_pin;
+              irq->active_low
+                = (intr->flags & MP_POLARITY_LOW) == MP_POLARITY_LOW;
+              irq->level_triggered
+                = (intr->flags & MP_TRIGGER_LEVEL) == MP_TRIGGER_LEVEL;
+            }
+        }
+      p += 8;
+    }
+
+  /* Boot processor not listed?  Fall back to a uniprocessor. */
+  if (!found_bsp)
+    cpu_cnt = 0;
+}
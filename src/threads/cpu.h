@@ -0,0 +1,66 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <list.h>
+#include <rbtree.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/cpu-local.h"
+#include "threads/thread.h"
+
+/* Per-CPU state.
+
+   Only the boot CPU runs threads: the others found in the MP
+   configuration table are recorded but never started, so every
+   thread's `cpu' member points to cpus[0].  The run queue is
+   kept here rather than in thread.c so that the scheduler
+   already names the CPU whose queue it uses. */
+struct cpu
+  {
+    unsigned id;                        /* Index into cpus[]. */
+    uint8_t lapic_id;                   /* Local APIC ID. */
+    struct thread *idle_thread;         /* This CPU's idle thread. */
+
+    /* Run queue: one FIFO list per priority, and a bitmap with bit
+       (P - PRI_MIN) set iff the list for priority P is non-empty.
+       Accessed only with interrupts off. */
+    struct list ready_lists[NUM_PRIORITIES];
+    uint64_t ready_lists_bitmap;
+    int ready_cnt;                      /* Threads in the run queue. */
+
+    /* Run queue under the completely fair scheduler, which uses
+       this instead of ready_lists: ready threads ordered by
+       vruntime.  Also accessed only with interrupts off. */
+    struct rb_tree cfs_tree;
+    int64_t min_vruntime;               /* Monotonic floor of vruntimes. */
+    unsigned long cfs_load;             /* Sum of weights in cfs_tree. */
+  };
+
+/* CPUs found at boot.  cpus[0] is the boot CPU. */
+extern struct cpu cpus[CPU_MAX];
+extern unsigned cpu_cnt;
+
+/* Interrupt controllers described by the MP configuration table.
+   All zero if no table was found. */
+extern uint32_t mp_lapic_paddr;         /* Local APIC registers. */
+extern uint32_t mp_ioapic_paddr;        /* First I/O APIC's registers. */
+extern uint8_t mp_ioapic_id;            /* First I/O APIC's ID. */
+extern bool mp_imcr_present;            /* PIC mode: IMCR must be set. */
+
+/* How an ISA IRQ is wired to the I/O APIC. */
+struct mp_isa_irq
+  {
+    uint8_t pin;                        /* I/O APIC input. */
+    bool active_low;                    /* Polarity. */
+    bool level_triggered;               /* Trigger mode. */
+  };
+
+/* Routing of ISA IRQs 0...15, identity unless the table says
+   otherwise. */
+extern struct mp_isa_irq mp_isa_irqs[16];
+
+void cpu_init (void);
+struct cpu *cpu_current (void);
+struct cpu *cpu_boot (void);
+
+#endif /* threads/cpu.h */
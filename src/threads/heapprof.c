@@ -0,0 +1,246 @@
+#include "threads/heapprof.h"
+#ifdef HEAPPROF
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/vmalloc.h"
+
+/* The profiler keeps two open-addressed hash tables with linear
+   probing, both allocated by heapprof_init():
+
+   - The site table, keyed by call site, accumulates the
+     statistics for each call site.  Sites are never removed.
+
+   - The block table, keyed by block address, maps each live
+     block to its size and the index of its site in the site
+     table, so that freeing a block can be charged back to the
+     site that allocated it.  Freed blocks are removed with
+     backward-shift deletion, so no tombstones build up.
+
+   A block that does not fit in either table is counted as
+   untracked, and freeing it has no effect on the profile.
+
+   The tables are updated with interrupts off, which suffices
+   because only the boot CPU runs. */
+
+/* Site table. */
+#define SITE_BITS 10
+#define SITE_CNT (1 << SITE_BITS)
+#define SITE_MAX (SITE_CNT / 4 * 3)     /* Maximum sites, for short probes. */
+
+/* Block table. */
+#define BLOCK_BITS 14
+#define BLOCK_CNT (1 << BLOCK_BITS)
+#define BLOCK_MAX (BLOCK_CNT / 4 * 3)   /* Maximum blocks, for short probes. */
+
+/* A call site. */
+struct site
+  {
+    const void *caller;                 /* Return address, or null if unused. */
+    size_t live_bytes;                  /* Bytes allocated and not yet freed. */
+    size_t live_blocks;                 /* Blocks allocated and not yet freed. */
+    unsigned long long alloc_cnt;       /* Total allocations. */
+  };
+
+/* A live block. */
+struct block_rec
+  {
+    const void *block;                  /* Block address, or null if unused. */
+    uint32_t size;                      /* Size requested, in bytes. */
+    uint16_t site;                      /* Index in sites[]. */
+  };
+
+/* Profile the heap?
+   Controlled by kernel command-line option "-heapprof". */
+bool heapprof_enabled;
+
+static struct site *sites;              /* Site table. */
+static size_t site_cnt;                 /* Number of sites in use. */
+static struct block_rec *blocks;        /* Block table, null if not profiling. */
+static size_t block_cnt;                /* Number of blocks in use. */
+static unsigned long long untracked_cnt; /* Allocations not tracked. */
+
+/* Returns the home slot for pointer P in a table of 2**BITS
+   slots. */
+static size_t
+hash_ptr (const void *p, int bits)
+{
+  return ((uint32_t) (uintptr_t) p * 0x9e3779b1u) >> (32 - bits);
+}
+
+/* Allocates the profiler's tables if profiling was requested.
+   Allocations made before this are not tracked.  Must be called
+   after vmalloc_init(). */
+void
+heapprof_init (void)
+{
+  if (!heapprof_enabled)
+    return;
+
+  sites = vmalloc (SITE_CNT * sizeof *sites);
+  blocks = vmalloc (BLOCK_CNT * sizeof *blocks);
+  if (sites == NULL || blocks == NULL)
+    {
+      printf ("heapprof: not enough memory for profile tables\n");
+      vfree (sites);
+      vfree (blocks);
+      sites = NULL;
+      blocks = NULL;
+      return;
+    }
+  memset (sites, 0, SITE_CNT * sizeof *sites);
+  memset (blocks, 0, BLOCK_CNT * sizeof *blocks);
+}
+
+/* Returns the index of CALLER in the site table, adding it if
+   necessary, or SITE_CNT if the table is full. */
+static size_t
+find_site (const void *caller)
+{
+  size_t i;
+
+  for (i = hash_ptr (caller, SITE_BITS); sites[i].caller != NULL;
+       i = (i + 1) % SITE_CNT)
+    if (sites[i].caller == caller)
+      return i;
+
+  if (site_cnt >= SITE_MAX)
+    return SITE_CNT;
+  site_cnt++;
+  sites[i].caller = caller;
+  return i;
+}
+
+/* Records that the call returning to SITE allocated BLOCK, of
+   SIZE bytes.  A null BLOCK, from a failed allocation, is
+   ignored. */
+void
+heapprof_alloc (const void *site, const void *block, size_t size)
+{
+  enum intr_level old_level;
+  size_t s, i;
+
+  if (block == NULL)
+    return;
+
+  old_level = intr_disable ();
+  if (blocks != NULL)
+    {
+      s = find_site (site);
+      if (s == SITE_CNT || block_cnt >= BLOCK_MAX)
+        untracked_cnt++;
+      else
+        {
+          for (i = hash_ptr (block, BLOCK_BITS); blocks[i].block != NULL;
+               i = (i + 1) % BLOCK_CNT)
+            ASSERT (blocks[i].block != block);
+          blocks[i].block = block;
+          blocks[i].size = size;
+          blocks[i].site = s;
+          block_cnt++;
+
+          sites[s].live_bytes += size;
+          sites[s].live_blocks++;
+          sites[s].alloc_cnt++;
+        }
+    }
+  intr_set_level (old_level);
+}
+
+/* Records that BLOCK was freed.  A null BLOCK is ignored. */
+void
+heapprof_free (const void *block)
+{
+  enum intr_level old_level;
+  size_t i, j;
+
+  if (block == NULL)
+    return;
+
+  old_level = intr_disable ();
+  if (blocks != NULL)
+    {
+      for (i = hash_ptr (block, BLOCK_BITS); blocks[i].block != NULL;
+           i = (i + 1) % BLOCK_CNT)
+        if (blocks[i].block == block)
+          break;
+
+      if (blocks[i].block != NULL)
+        {
+          struct site *s = &sites[blocks[i].site];
+          s->live_bytes -= blocks[i].size;
+          s->live_blocks--;
+          block_cnt--;
+
+          /* Remove slot I, moving later entries in its probe
+             sequence back to fill the hole. */
+          for (j = (i + 1) % BLOCK_CNT; blocks[j].block != NULL;
+               j = (j + 1) % BLOCK_CNT)
+            {
+              size_t home = hash_ptr (blocks[j].block, BLOCK_BITS);
+              bool stays = (i <= j
+                            ? i < home && home <= j
+                            : i < home || home <= j);
+              if (!stays)
+                {
+                  blocks[i] = blocks[j];
+                  i = j;
+                }
+            }
+          blocks[i].block = NULL;
+        }
+    }
+  intr_set_level (old_level);
+}
+
+/* Stops profiling and prints the profile, with the call sites
+   in decreasing order of live bytes. */
+void
+heapprof_dump (void)
+{
+  enum intr_level old_level;
+  size_t live_bytes, live_blocks;
+  size_t cnt, i, j;
+
+  old_level = intr_disable ();
+  if (blocks == NULL)
+    {
+      intr_set_level (old_level);
+      return;
+    }
+  blocks = NULL;
+  intr_set_level (old_level);
+
+  /* The site table is no longer needed as a hash table, so
+     compact and sort it in place. */
+  cnt = 0;
+  live_bytes = live_blocks = 0;
+  for (i = 0; i < SITE_CNT; i++)
+    if (sites[i].caller != NULL)
+      {
+        struct site s = sites[i];
+        live_bytes += s.live_bytes;
+        live_blocks += s.live_blocks;
+        for (j = cnt++; j > 0 && sites[j - 1].live_bytes < s.live_bytes; j--)
+          sites[j] = sites[j - 1];
+        sites[j] = s;
+      }
+
+  printf ("Heap profile: %zu bytes live in %zu blocks from %zu call sites, "
+          "%llu allocations untracked\n",
+          live_bytes, live_blocks, cnt, untracked_cnt);
+  printf ("%12s %12s %12s  %s\n",
+          "live bytes", "live blocks", "allocs", "call site");
+  for (i = 0; i < cnt; i++)
+    printf ("%12zu %12zu %12llu  %p\n", sites[i].live_bytes,
+            sites[i].live_blocks, sites[i].alloc_cnt, sites[i].caller);
+
+  /* In the format expected by utils/backtrace. */
+  printf ("Call sites:");
+  for (i = 0; i < cnt; i++)
+    printf (" %p", sites[i].caller);
+  printf ("\n");
+}
+#endif /* HEAPPROF */
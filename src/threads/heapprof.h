@@ -0,0 +1,30 @@
+#ifndef THREADS_HEAPPROF_H
+#define THREADS_HEAPPROF_H
+
+/* Kernel heap profiler.
+
+   In a kernel built with -DHEAPPROF (see OPT_DEFINES in
+   Make.config), malloc(), calloc(), realloc(), free(),
+   kmem_cache_alloc(), and kmem_cache_free() report each block to
+   the profiler, which charges it to the return address of the
+   call that allocated it.  With the "-heapprof" kernel
+   command-line option, the live bytes and blocks and the total
+   allocations of each call site are printed at shutdown, followed
+   by a line that can be passed to utils/backtrace to turn the
+   call sites into function names and line numbers. */
+
+#ifdef HEAPPROF
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Profile the heap?
+   Controlled by kernel command-line option "-heapprof". */
+extern bool heapprof_enabled;
+
+void heapprof_init (void);
+void heapprof_alloc (const void *site, const void *block, size_t size);
+void heapprof_free (const void *block);
+void heapprof_dump (void);
+#endif
+
+#endif /* threads/heapprof.h */
@@ -15,13 +15,17 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/heapprof.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/page-copy.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vmalloc.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -39,7 +43,9 @@
 #endif
 
 #ifdef VM
+#include "vm/frame.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -102,6 +108,15 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  vmalloc_init ();
+#ifdef VM
+  frame_table_init ();
+#endif
+#ifdef HEAPPROF
+  heapprof_init ();
+#endif
+  page_copy_init ();
+  trace_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -133,6 +148,9 @@ main (void)
 
 
   swap_init();
+#ifdef VM
+  frame_reclaim_init ();
+#endif
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -256,12 +274,42 @@ parse_options (char **argv)
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-evict"))
+        {
+          if (value == NULL || !frame_set_evict_policy (value))
+            PANIC ("unknown eviction policy `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-zswap"))
+        zswap_pages = atoi (value);
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-cfs"))
+        thread_cfs = true;
+      else if (!strcmp (name, "-cfs-gran"))
+        thread_cfs_min_granularity = atoi (value);
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-apic"))
+        intr_apic = true;
+      else if (!strcmp (name, "-trace"))
+        {
+          if (value == NULL || strcmp (value, "sched"))
+            PANIC ("unknown trace `%s' (use -h for help)",
+                   value != NULL ? value : "");
+          trace_sched = true;
+        }
+      else if (!strcmp (name, "-heapprof"))
+#ifdef HEAPPROF
+        heapprof_enabled = true;
+#else
+        PANIC ("-heapprof needs a kernel built with -DHEAPPROF "
+               "(see OPT_DEFINES in Make.config)");
+#endif
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -270,6 +318,11 @@ parse_options (char **argv)
         PANIC ("unknown option `%s' (use -h for help)", name);
     }
 
+  if (thread_mlfqs && thread_cfs)
+    PANIC ("-mlfqs and -cfs are mutually exclusive");
+  if (thread_cfs_min_granularity < 1)
+    PANIC ("-cfs-gran must be at least 1 tick");
+
   /* Initialize the random number generator based on the system
      time.  This has no effect if an "-rs" option was specified.
 
@@ -381,10 +434,21 @@ usage (void)
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -evict=POLICY      Evict by POLICY: random, clock (default),\n"
+          "                     wsclock, 2q, or arc.\n"
+          "  -zswap=PAGES       Compress swapped pages into at most PAGES\n"
+          "                     pages of RAM; 0 sends them straight to the\n"
+          "                     swap device.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -cfs               Use completely fair scheduler.\n"
+          "  -cfs-gran=TICKS    Run at least TICKS ticks before CFS preempts.\n"
+          "  -tickless          Stop the timer tick while the CPU is idle.\n"
+          "  -apic              Use the local and I/O APICs, if present.\n"
+          "  -trace=sched       Trace scheduler events to scratch at shutdown.\n"
+          "  -heapprof          Print heap use by call site at shutdown.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
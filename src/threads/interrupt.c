@@ -3,6 +3,7 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "threads/apic.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
@@ -47,6 +48,16 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* If false (default), deliver external interrupts through the 8259A
+   PICs.  If true, use the local and I/O APICs where present (see
+   apic.c), falling back to the PICs otherwise.
+   Controlled by kernel command-line option "-apic". */
+bool intr_apic;
+
+/* True if external interrupts are acknowledged on the local APIC
+   rather than the PICs. */
+static bool using_apic;
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -120,7 +131,9 @@ intr_init (void)
   uint64_t idtr_operand;
   int i;
 
-  /* Initialize interrupt controller. */
+  /* Initialize interrupt controller.  The PICs are set up even
+     when the APICs take over, so that any interrupt they raise
+     spuriously lands on a recognizable vector. */
   pic_init ();
 
   /* Initialize IDT. */
@@ -155,6 +168,11 @@ intr_init (void)
   intr_names[17] = "#AC Alignment Check Exception";
   intr_names[18] = "#MC Machine-Check Exception";
   intr_names[19] = "#XF SIMD Floating-Point Exception";
+
+  /* Switch to the APICs last: apic_init() registers handlers,
+     which needs the IDT and intr_names[] set up. */
+  if (intr_apic)
+    using_apic = apic_init ();
 }
 
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
@@ -359,6 +377,9 @@ intr_handler (struct intr_frame *frame)
 
       in_external_intr = true;
       yield_on_return = false;
+
+      /* Catch up on ticks skipped while the CPU was idle. */
+      timer_intr_enter ();
     }
 
   /* Invoke the interrupt's handler. */
@@ -381,7 +402,10 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_context ());
 
       in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
+      if (using_apic)
+        apic_end_of_interrupt ();
+      else
+        pic_end_of_interrupt (frame->vec_no); 
 
       if (yield_on_return) 
         thread_yield (); 
@@ -57,6 +57,10 @@ struct intr_frame
 
 typedef void intr_handler_func (struct intr_frame *);
 
+/* Use the APICs instead of the PICs, if present?
+   Controlled by kernel command-line option "-apic". */
+extern bool intr_apic;
+
 void intr_init (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
@@ -5,6 +5,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu-local.h"
+#include "threads/heapprof.h"
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,7 +35,25 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   In front of each descriptor's free list, each CPU has a
+   "magazine": a small stack of free blocks of that size that
+   only that CPU touches, with interrupts disabled, so that most
+   calls to malloc() and free() take no lock.  An empty magazine
+   is refilled with MAG_BATCH blocks from the free list, and a
+   full one drains MAG_BATCH blocks back to it, so the
+   descriptor's lock is taken at most once per MAG_BATCH calls.
+   Blocks in magazines count as in use as far as their arenas
+   are concerned, so an arena is not freed while any of its
+   blocks is in a magazine. */
+
+/* Number of blocks a magazine holds. */
+#define MAG_SIZE 16
+
+/* Number of blocks moved at a time between a magazine and its
+   descriptor's free list. */
+#define MAG_BATCH (MAG_SIZE / 2)
 
 /* Descriptor. */
 struct desc
@@ -41,6 +62,21 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+    size_t arena_cnt;           /* Number of arenas. */
+    size_t max_arena_cnt;       /* Peak of arena_cnt. */
+  };
+
+/* Per-CPU cache of free blocks for one descriptor. */
+struct magazine
+  {
+    size_t cnt;                         /* Number of blocks in ROUNDS. */
+    struct block *rounds[MAG_SIZE];     /* Free blocks. */
+
+    /* Statistics. */
+    unsigned long long alloc_hits;      /* malloc()s served here. */
+    unsigned long long alloc_misses;    /* malloc()s that refilled. */
+    unsigned long long free_hits;       /* free()s kept here. */
+    unsigned long long free_misses;     /* free()s that drained. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -64,8 +100,15 @@ struct block
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Magazines, by CPU and descriptor. */
+static struct magazine magazines[CPU_MAX][sizeof descs / sizeof *descs];
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *do_malloc (size_t);
+static void do_free (void *);
+static struct block *refill_magazine (struct desc *);
+static void drain_magazine (struct desc *, struct block *);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -81,6 +124,7 @@ malloc_init (void)
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
       lock_init (&d->lock);
+      d->arena_cnt = d->max_arena_cnt = 0;
     }
 }
 
@@ -88,10 +132,23 @@ malloc_init (void)
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  void *p = do_malloc (size);
+#ifdef HEAPPROF
+  heapprof_alloc (__builtin_return_address (0), p, size);
+#endif
+  return p;
+}
+
+/* Allocates a block for malloc(), calloc(), or realloc(). */
+static void *
+do_malloc (size_t size) 
 {
   struct desc *d;
   struct block *b;
   struct arena *a;
+  struct magazine *m;
+  enum intr_level old_level;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -119,38 +176,19 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* Take a block from this CPU's magazine, if it has one. */
+  old_level = intr_disable ();
+  m = &magazines[cpu_current_id ()][d - descs];
+  if (m->cnt > 0)
     {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      b = m->rounds[--m->cnt];
+      m->alloc_hits++;
+      intr_set_level (old_level);
+      return b;
     }
+  intr_set_level (old_level);
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
-  return b;
+  return refill_magazine (d);
 }
 
 /* Allocates and return A times B bytes initialized to zeroes.
@@ -167,9 +205,12 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = do_malloc (size);
   if (p != NULL)
     memset (p, 0, size);
+#ifdef HEAPPROF
+  heapprof_alloc (__builtin_return_address (0), p, size);
+#endif
 
   return p;
 }
@@ -196,18 +237,27 @@ realloc (void *old_block, size_t new_size)
 {
   if (new_size == 0) 
     {
-      free (old_block);
+#ifdef HEAPPROF
+      heapprof_free (old_block);
+#endif
+      do_free (old_block);
       return NULL;
     }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = do_malloc (new_size);
+#ifdef HEAPPROF
+      heapprof_alloc (__builtin_return_address (0), new_block, new_size);
+#endif
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
           size_t min_size = new_size < old_size ? new_size : old_size;
           memcpy (new_block, old_block, min_size);
-          free (old_block);
+#ifdef HEAPPROF
+          heapprof_free (old_block);
+#endif
+          do_free (old_block);
         }
       return new_block;
     }
@@ -217,6 +267,16 @@ realloc (void *old_block, size_t new_size)
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) 
+{
+#ifdef HEAPPROF
+  heapprof_free (p);
+#endif
+  do_free (p);
+}
+
+/* Frees block P for free() or realloc(). */
+static void
+do_free (void *p) 
 {
   if (p != NULL)
     {
@@ -228,31 +288,27 @@ free (void *p)
         {
           /* It's a normal block.  We handle it here. */
 
+          struct magazine *m;
+          enum intr_level old_level;
+
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          /* Put the block in this CPU's magazine, if it has room. */
+          old_level = intr_disable ();
+          m = &magazines[cpu_current_id ()][d - descs];
+          if (m->cnt < MAG_SIZE)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              m->rounds[m->cnt++] = b;
+              m->free_hits++;
+              intr_set_level (old_level);
+              return;
             }
+          intr_set_level (old_level);
 
-          lock_release (&d->lock);
+          drain_magazine (d, b);
         }
       else
         {
@@ -263,6 +319,158 @@ free (void *p)
     }
 }
 
+/* Prints malloc() statistics for each size class that has been
+   used: how often each CPU's magazines satisfied malloc() and
+   free() without taking the descriptor's lock, and the number of
+   arenas. */
+void
+malloc_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    {
+      struct desc *d = &descs[i];
+      unsigned long long allocs = 0, alloc_hits = 0;
+      unsigned long long frees = 0, free_hits = 0;
+      unsigned cpu;
+
+      for (cpu = 0; cpu < CPU_MAX; cpu++)
+        {
+          struct magazine *m = &magazines[cpu][i];
+          allocs += m->alloc_hits + m->alloc_misses;
+          alloc_hits += m->alloc_hits;
+          frees += m->free_hits + m->free_misses;
+          free_hits += m->free_hits;
+        }
+      if (allocs == 0)
+        continue;
+
+      printf ("Malloc: %zu-byte blocks: %llu allocs, %llu%% from magazines; "
+              "%llu frees, %llu%% to magazines; %zu arenas (peak %zu)\n",
+              d->block_size, allocs, alloc_hits * 100 / allocs,
+              frees, frees > 0 ? free_hits * 100 / frees : 0,
+              d->arena_cnt, d->max_arena_cnt);
+    }
+}
+
+/* Takes MAG_BATCH blocks from descriptor D's free list, creating
+   arenas as needed, and returns one of them.  The others go into
+   the current CPU's magazine for D, as far as it has room; any
+   that don't fit go back to the free list.  Returns a null
+   pointer if memory is not available. */
+static struct block *
+refill_magazine (struct desc *d)
+{
+  struct block *batch[MAG_BATCH];
+  struct magazine *m;
+  enum intr_level old_level;
+  size_t cnt, i;
+
+  lock_acquire (&d->lock);
+
+  /* Take the blocks from the free list. */
+  for (cnt = 0; cnt < MAG_BATCH; cnt++)
+    {
+      struct block *b;
+
+      /* If the free list is empty, create a new arena. */
+      if (list_empty (&d->free_list))
+        {
+          struct arena *a = palloc_get_page (0);
+          if (a == NULL)
+            break;
+
+          /* Initialize arena and add its blocks to the free list. */
+          a->magic = ARENA_MAGIC;
+          a->desc = d;
+          a->free_cnt = d->blocks_per_arena;
+          for (i = 0; i < d->blocks_per_arena; i++)
+            {
+              struct block *b = arena_to_block (a, i);
+              list_push_back (&d->free_list, &b->free_elem);
+            }
+          if (++d->arena_cnt > d->max_arena_cnt)
+            d->max_arena_cnt = d->arena_cnt;
+        }
+
+      b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+      block_to_arena (b)->free_cnt--;
+      batch[cnt] = b;
+    }
+  if (cnt == 0)
+    {
+      lock_release (&d->lock);
+      return NULL;
+    }
+
+  /* Stock the magazine with all but the first.  Another thread
+     may have filled the magazine while we waited for the lock, so
+     it might not have room for all of them. */
+  old_level = intr_disable ();
+  m = &magazines[cpu_current_id ()][d - descs];
+  m->alloc_misses++;
+  for (i = 1; i < cnt && m->cnt < MAG_SIZE; i++)
+    m->rounds[m->cnt++] = batch[i];
+  intr_set_level (old_level);
+
+  for (; i < cnt; i++)
+    {
+      block_to_arena (batch[i])->free_cnt++;
+      list_push_front (&d->free_list, &batch[i]->free_elem);
+    }
+
+  lock_release (&d->lock);
+  return batch[0];
+}
+
+/* Returns block B, which the current CPU's magazine for
+   descriptor D had no room for, along with MAG_BATCH blocks from
+   the magazine, to D's free list.  Frees any arenas left
+   entirely unused. */
+static void
+drain_magazine (struct desc *d, struct block *b)
+{
+  struct block *batch[MAG_BATCH + 1];
+  struct magazine *m;
+  enum intr_level old_level;
+  size_t cnt, i;
+
+  /* Take blocks out of the magazine. */
+  batch[0] = b;
+  old_level = intr_disable ();
+  m = &magazines[cpu_current_id ()][d - descs];
+  m->free_misses++;
+  for (cnt = 1; cnt <= MAG_BATCH && m->cnt > 0; cnt++)
+    batch[cnt] = m->rounds[--m->cnt];
+  intr_set_level (old_level);
+
+  lock_acquire (&d->lock);
+  for (i = 0; i < cnt; i++)
+    {
+      struct arena *a = block_to_arena (batch[i]);
+
+      /* Add block to free list. */
+      list_push_front (&d->free_list, &batch[i]->free_elem);
+
+      /* If the arena is now entirely unused, free it. */
+      if (++a->free_cnt >= d->blocks_per_arena)
+        {
+          size_t j;
+
+          ASSERT (a->free_cnt == d->blocks_per_arena);
+          for (j = 0; j < d->blocks_per_arena; j++)
+            {
+              struct block *b = arena_to_block (a, j);
+              list_remove (&b->free_elem);
+            }
+          palloc_free_page (a);
+          d->arena_cnt--;
+        }
+    }
+  lock_release (&d->lock);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -0,0 +1,203 @@
+#include "threads/page-copy.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Whole-page copies using the MMX or SSE registers.
+
+   Pintos runs with CR0.EM set, so that any floating-point
+   instruction traps, and neither the kernel nor user programs
+   ever have live FPU, MMX, or SSE state.  That means the kernel
+   can borrow those registers without saving them, as long as
+   nothing else can run on the CPU meanwhile.  So the copies here
+   run with interrupts disabled, clear CR0.EM (and, for SSE, set
+   CR4.OSFXSR) for just the duration of the copy, and restore
+   both afterward.  They may be called with interrupts either on
+   or off. */
+
+/* CR0 and CR4 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR0_EM 0x00000004       /* (Floating-point) Emulation. */
+#define CR0_TS 0x00000008       /* Task Switched. */
+#define CR4_OSFXSR 0x00000200   /* OS supports FXSAVE/FXRSTOR and SSE. */
+
+/* CPUID leaf 1 EDX feature bits. */
+#define CPUID_MMX (1u << 23)
+#define CPUID_SSE2 (1u << 26)
+
+/* Methods this CPU supports, as a bit mask by method. */
+static unsigned supported = 1u << PAGE_COPY_REP;
+
+/* Method used by page_copy(). */
+static enum page_copy_method best_method = PAGE_COPY_REP;
+
+static uint32_t read_cr0 (void);
+static void write_cr0 (uint32_t);
+static uint32_t read_cr4 (void);
+static void write_cr4 (uint32_t);
+
+/* Finds out which copy methods the CPU supports and picks the
+   fastest for page_copy(). */
+void
+page_copy_init (void)
+{
+  uint32_t a, b, c, d;
+
+  asm volatile ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (1));
+  if (d & CPUID_MMX)
+    {
+      supported |= 1u << PAGE_COPY_MMX;
+      best_method = PAGE_COPY_MMX;
+    }
+  if (d & CPUID_SSE2)
+    {
+      supported |= 1u << PAGE_COPY_SSE2;
+      best_method = PAGE_COPY_SSE2;
+    }
+}
+
+/* Returns true if METHOD can be used on this CPU. */
+bool
+page_copy_supported (enum page_copy_method method)
+{
+  return method < PAGE_COPY_METHOD_CNT && (supported & (1u << method)) != 0;
+}
+
+/* Returns METHOD's name. */
+const char *
+page_copy_method_name (enum page_copy_method method)
+{
+  switch (method)
+    {
+    case PAGE_COPY_REP:
+      return "rep";
+    case PAGE_COPY_MMX:
+      return "mmx";
+    case PAGE_COPY_SSE2:
+      return "sse2";
+    default:
+      return "unknown";
+    }
+}
+
+/* Copies the page at SRC to DST using METHOD, which must be
+   supported.  Both must be page-aligned and must not overlap. */
+void
+page_copy_using (enum page_copy_method method, void *dst, const void *src)
+{
+  enum intr_level old_level;
+  uint32_t cr0, cr4;
+  size_t cnt = PGSIZE / 64;
+
+  ASSERT (pg_ofs (dst) == 0);
+  ASSERT (pg_ofs (src) == 0);
+  ASSERT (page_copy_supported (method));
+
+  if (method == PAGE_COPY_REP)
+    {
+      memcpy (dst, src, PGSIZE);
+      return;
+    }
+
+  old_level = intr_disable ();
+  cr0 = read_cr0 ();
+  write_cr0 (cr0 & ~(CR0_EM | CR0_TS));
+
+  if (method == PAGE_COPY_MMX)
+    asm volatile ("1:\n\t"
+                  "movq (%1), %%mm0\n\t"
+                  "movq 8(%1), %%mm1\n\t"
+                  "movq 16(%1), %%mm2\n\t"
+                  "movq 24(%1), %%mm3\n\t"
+                  "movq 32(%1), %%mm4\n\t"
+                  "movq 40(%1), %%mm5\n\t"
+                  "movq 48(%1), %%mm6\n\t"
+                  "movq 56(%1), %%mm7\n\t"
+                  "movq %%mm0, (%0)\n\t"
+                  "movq %%mm1, 8(%0)\n\t"
+                  "movq %%mm2, 16(%0)\n\t"
+                  "movq %%mm3, 24(%0)\n\t"
+                  "movq %%mm4, 32(%0)\n\t"
+                  "movq %%mm5, 40(%0)\n\t"
+                  "movq %%mm6, 48(%0)\n\t"
+                  "movq %%mm7, 56(%0)\n\t"
+                  "addl $64, %0\n\t"
+                  "addl $64, %1\n\t"
+                  "decl %2\n\t"
+                  "jnz 1b\n\t"
+                  "emms"
+                  : "+r" (dst), "+r" (src), "+r" (cnt)
+                  : : "memory", "cc");
+  else
+    {
+      cr4 = read_cr4 ();
+      write_cr4 (cr4 | CR4_OSFXSR);
+
+      /* Non-temporal stores bypass the cache, so copying a page
+         doesn't evict a page's worth of useful data, and the
+         final "sfence" makes them visible in order. */
+      asm volatile ("1:\n\t"
+                    "movdqa (%1), %%xmm0\n\t"
+                    "movdqa 16(%1), %%xmm1\n\t"
+                    "movdqa 32(%1), %%xmm2\n\t"
+                    "movdqa 48(%1), %%xmm3\n\t"
+                    "movntdq %%xmm0, (%0)\n\t"
+                    "movntdq %%xmm1, 16(%0)\n\t"
+                    "movntdq %%xmm2, 32(%0)\n\t"
+                    "movntdq %%xmm3, 48(%0)\n\t"
+                    "addl $64, %0\n\t"
+                    "addl $64, %1\n\t"
+                    "decl %2\n\t"
+                    "jnz 1b\n\t"
+                    "sfence"
+                    : "+r" (dst), "+r" (src), "+r" (cnt)
+                    : : "memory", "cc");
+
+      write_cr4 (cr4);
+    }
+
+  write_cr0 (cr0);
+  intr_set_level (old_level);
+}
+
+/* Copies the page at SRC to DST, which must both be page-aligned
+   and must not overlap, using the fastest method this CPU
+   supports. */
+void
+page_copy (void *dst, const void *src)
+{
+  page_copy_using (best_method, dst, src);
+}
+
+/* Returns the value of CR0. */
+static uint32_t
+read_cr0 (void)
+{
+  uint32_t cr0;
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+/* Sets CR0 to CR0. */
+static void
+write_cr0 (uint32_t cr0)
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0) : "memory");
+}
+
+/* Returns the value of CR4. */
+static uint32_t
+read_cr4 (void)
+{
+  uint32_t cr4;
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  return cr4;
+}
+
+/* Sets CR4 to CR4. */
+static void
+write_cr4 (uint32_t cr4)
+{
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+}
@@ -0,0 +1,22 @@
+#ifndef THREADS_PAGE_COPY_H
+#define THREADS_PAGE_COPY_H
+
+#include <stdbool.h>
+
+/* Ways to copy a page. */
+enum page_copy_method
+  {
+    PAGE_COPY_REP,              /* "rep movsl", as memcpy(). */
+    PAGE_COPY_MMX,              /* 64 bytes at a time in MMX registers. */
+    PAGE_COPY_SSE2,             /* 64 bytes at a time in SSE registers,
+                                   with non-temporal stores. */
+    PAGE_COPY_METHOD_CNT
+  };
+
+void page_copy_init (void);
+bool page_copy_supported (enum page_copy_method);
+const char *page_copy_method_name (enum page_copy_method);
+void page_copy_using (enum page_copy_method, void *dst, const void *src);
+void page_copy (void *dst, const void *src);
+
+#endif /* threads/page-copy.h */
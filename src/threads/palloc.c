@@ -1,14 +1,14 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,14 +23,67 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Free memory is kept
+   as blocks of 2**ORDER pages, aligned (relative to the pool
+   base) to their own size, on one free list per order.  A
+   request for N pages takes a block of the smallest order that
+   fits, splitting larger blocks as needed, then gives back the
+   pages past N.  (Thus N pages can only be had if a free block
+   of at least N rounded up to a power of 2 exists.)  Freeing a
+   block merges it with its "buddy", the other half of the next
+   larger block, for as long as the buddy is also free.  Both
+   take O(log n) time in the size of the pool.
+
+   The list_elem linking a free block into its free list is kept
+   in the block's first page, so the only other memory the pool
+   needs is one byte per page recording which pages begin free
+   blocks and their orders.
+
+   A pool is protected by turning interrupts off rather than by a
+   lock.  thread_schedule_tail() frees a dying thread's page in
+   the middle of a context switch, where it must not sleep, and
+   every operation on the free lists is short.
+
+   The idle thread keeps a small stock of zeroed pages in each
+   pool, up to ZEROED_MAX (or a sixteenth of the pool, whichever
+   is less), so that single-page PAL_ZERO requests usually need
+   not clear a page while their caller waits.  Zeroed pages are
+   allocated from the buddy system while they sit in stock, but
+   any single-page request falls back on them when the pool is
+   otherwise empty, so they never make an allocation fail. */
+
+/* Most zeroed pages kept in stock in each pool. */
+#define ZEROED_MAX 64
+
+/* Largest block order.  Enough for a 4 GB pool. */
+#define MAX_ORDER 20
+
+/* Page state bytes.  A page that begins a free block of order
+   N has state PAGE_FREE | N; every other page, whether
+   allocated or inside a free block, has state PAGE_BUSY. */
+#define PAGE_BUSY 0
+#define PAGE_FREE 0x80
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct list free_lists[MAX_ORDER + 1]; /* Free blocks by order. */
+    uint8_t *page_state;                /* State of each page. */
+    size_t page_cnt;                    /* Number of pages in pool. */
     uint8_t *base;                      /* Base of pool. */
+    const char *name;                   /* Name, for statistics. */
+    size_t free_cnt;                    /* Free pages, counting zeroed ones. */
+
+    /* Stock of zeroed pages, linked through their first bytes. */
+    struct list zeroed_pages;           /* Zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of zeroed pages. */
+    size_t zeroed_max;                  /* Target for zeroed_cnt. */
+
+    /* Statistics. */
+    unsigned long long zero_hits;       /* PAL_ZERO pages from stock. */
+    unsigned long long zero_misses;     /* PAL_ZERO pages cleared on demand. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +92,9 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_block (struct pool *, size_t page_cnt);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static bool prezero_page (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -71,27 +127,51 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void *pages;
+  void *pages = NULL;
+  bool zeroed = false;
+  enum intr_level old_level;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+  old_level = intr_disable ();
+  if (page_cnt == 1 && (flags & PAL_ZERO)
+      && !list_empty (&pool->zeroed_pages))
+    zeroed = true;
   else
-    pages = NULL;
+    {
+      page_idx = alloc_block (pool, page_cnt);
+      if (page_idx != SIZE_MAX)
+        pages = pool->base + PGSIZE * page_idx;
+      else if (page_cnt == 1 && !list_empty (&pool->zeroed_pages))
+        zeroed = true;
+    }
+  if (zeroed)
+    {
+      pages = list_pop_front (&pool->zeroed_pages);
+      pool->zeroed_cnt--;
+    }
+  if (pages != NULL)
+    pool->free_cnt -= page_cnt;
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      if (zeroed)
+        pool->zero_hits++;
+      else
+        pool->zero_misses++;
+    }
+  intr_set_level (old_level);
 
-  if (pages != NULL) 
+  if (pages != NULL)
     {
-      if (flags & PAL_ZERO)
+      /* A zeroed page is clear except for its list_elem. */
+      if (zeroed)
+        memset (pages, 0, sizeof (struct list_elem));
+      else if (flags & PAL_ZERO)
         memset (pages, 0, PGSIZE * page_cnt);
     }
-  else 
+  else
     {
       if (flags & PAL_ASSERT)
         PANIC ("palloc_get: out of pages");
@@ -108,16 +188,17 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
    available, returns a null pointer, unless PAL_ASSERT is set in
    FLAGS, in which case the kernel panics. */
 void *
-palloc_get_page (enum palloc_flags flags) 
+palloc_get_page (enum palloc_flags flags)
 {
   return palloc_get_multiple (flags, 1);
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
-palloc_free_multiple (void *pages, size_t page_cnt) 
+palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -132,51 +213,243 @@ palloc_free_multiple (void *pages, size_t page_cnt)
     NOT_REACHED ();
 
   page_idx = pg_no (pages) - pg_no (pool->base);
+  ASSERT (page_idx + page_cnt <= pool->page_cnt);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  old_level = intr_disable ();
+  free_range (pool, page_idx, page_cnt);
+  pool->free_cnt += page_cnt;
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
 void
-palloc_free_page (void *page) 
+palloc_free_page (void *page)
 {
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of free pages in the user pool if PAL_USER
+   is set in FLAGS, otherwise in the kernel pool.  The count may
+   be out of date as soon as it is returned. */
+size_t
+palloc_free_cnt (enum palloc_flags flags)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  return pool->free_cnt;
+}
+
+/* Returns the address of the first page in the user pool, and
+   stores the number of pages in the pool in *PAGE_CNT. */
+void *
+palloc_user_pool (size_t *page_cnt)
+{
+  *page_cnt = user_pool.page_cnt;
+  return user_pool.base;
+}
+
+/* Zeroes one free page for a later PAL_ZERO request, if either
+   pool's stock of zeroed pages is below its target.  Returns
+   true if it did so, false if there was nothing to do. */
+bool
+palloc_prezero_page (void)
+{
+  return prezero_page (&user_pool) || prezero_page (&kernel_pool);
+}
+
+/* Prints statistics about single-page PAL_ZERO requests. */
+void
+palloc_print_stats (void)
+{
+  struct pool *pools[] = { &kernel_pool, &user_pool };
+  size_t i;
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct pool *p = pools[i];
+      unsigned long long requests = p->zero_hits + p->zero_misses;
+      if (requests > 0)
+        printf ("Palloc: %s: %llu zeroed pages requested, "
+                "%llu from idle-time stock\n",
+                p->name, requests, p->zero_hits);
+    }
+}
+
+/* Adds a page to POOL's stock of zeroed pages, if it is below
+   its target.  Returns true if successful. */
+static bool
+prezero_page (struct pool *pool)
+{
+  enum intr_level old_level;
+  bool success = false;
+
+  if (pool->zeroed_cnt >= pool->zeroed_max)
+    return false;
+
+  /* The page is cleared with interrupts still off, so that it is
+     never missing from both the free lists and the stock while
+     another thread looks for memory.  Clearing one page is
+     quick. */
+  old_level = intr_disable ();
+  if (pool->zeroed_cnt < pool->zeroed_max)
+    {
+      size_t page_idx = alloc_block (pool, 1);
+      if (page_idx != SIZE_MAX)
+        {
+          void *page = pool->base + PGSIZE * page_idx;
+          memset (page, 0, PGSIZE);
+          list_push_front (&pool->zeroed_pages, page);
+          pool->zeroed_cnt++;
+          success = true;
+        }
+    }
+  intr_set_level (old_level);
+
+  return success;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
+init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's page states at its base.
+     Calculate the space needed for them
      and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  size_t state_pages = DIV_ROUND_UP (page_cnt, PGSIZE);
+  int order;
+  if (state_pages > page_cnt)
+    PANIC ("Not enough memory in %s for page states.", name);
+  page_cnt -= state_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  /* Initialize the pool, with every page allocated, then free
+     them all to build the free lists. */
+  for (order = 0; order <= MAX_ORDER; order++)
+    list_init (&p->free_lists[order]);
+  p->page_state = base;
+  memset (p->page_state, PAGE_BUSY, page_cnt);
+  p->page_cnt = page_cnt;
+  p->base = base + state_pages * PGSIZE;
+  p->name = name;
+  p->free_cnt = page_cnt;
+  list_init (&p->zeroed_pages);
+  p->zeroed_cnt = 0;
+  p->zeroed_max = page_cnt / 16 < ZEROED_MAX ? page_cnt / 16 : ZEROED_MAX;
+  p->zero_hits = p->zero_misses = 0;
+  free_range (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
    false otherwise. */
 static bool
-page_from_pool (const struct pool *pool, void *page) 
+page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the list_elem kept in the first page of POOL's free
+   block that begins at page PAGE_IDX. */
+static struct list_elem *
+block_elem (const struct pool *pool, size_t page_idx)
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index of the page whose first bytes hold
+   ELEM, in POOL. */
+static size_t
+elem_block (const struct pool *pool, struct list_elem *elem)
+{
+  return ((uint8_t *) elem - pool->base) / PGSIZE;
+}
+
+/* Makes the 2**ORDER pages starting at PAGE_IDX in POOL, which
+   must all be allocated, into a free block, merging it with its
+   buddies as far as possible. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  ASSERT (page_idx % ((size_t) 1 << order) == 0);
+  ASSERT (pool->page_state[page_idx] == PAGE_BUSY);
+
+  for (; order < MAX_ORDER; order++)
+    {
+      size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+      if (buddy_idx >= pool->page_cnt
+          || pool->page_state[buddy_idx] != (PAGE_FREE | order))
+        break;
+
+      list_remove (block_elem (pool, buddy_idx));
+      pool->page_state[buddy_idx] = PAGE_BUSY;
+      if (buddy_idx < page_idx)
+        page_idx = buddy_idx;
+    }
+
+  pool->page_state[page_idx] = PAGE_FREE | order;
+  list_push_front (&pool->free_lists[order], block_elem (pool, page_idx));
+}
+
+/* Frees the PAGE_CNT allocated pages starting at PAGE_IDX in
+   POOL, as the largest aligned blocks that cover them. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+      while (order < MAX_ORDER
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or SIZE_MAX if no free block is large
+   enough. */
+static size_t
+alloc_block (struct pool *pool, size_t page_cnt)
+{
+  size_t page_idx;
+  int order, want;
+
+  /* Find the smallest free block that fits. */
+  for (want = 0; ((size_t) 1 << want) < page_cnt; want++)
+    if (want == MAX_ORDER)
+      return SIZE_MAX;
+  for (order = want; list_empty (&pool->free_lists[order]); order++)
+    if (order == MAX_ORDER)
+      return SIZE_MAX;
+  page_idx = elem_block (pool, list_pop_front (&pool->free_lists[order]));
+  pool->page_state[page_idx] = PAGE_BUSY;
+
+  /* Split it, freeing the upper halves, until it is no larger
+     than needed. */
+  while (order > want)
+    {
+      size_t half_idx;
+
+      order--;
+      half_idx = page_idx + ((size_t) 1 << order);
+      pool->page_state[half_idx] = PAGE_FREE | order;
+      list_push_front (&pool->free_lists[order], block_elem (pool, half_idx));
+    }
+
+  /* Give back the pages beyond PAGE_CNT. */
+  free_range (pool, page_idx + page_cnt, ((size_t) 1 << want) - page_cnt);
+
+  return page_idx;
+}
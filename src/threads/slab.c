@@ -0,0 +1,288 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/heapprof.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator for fixed-size objects.
+
+   Each slab is one page from the kernel pool, starting with a
+   struct slab header followed by as many objects as fit.  A
+   slab's free objects are chained through a pointer stored in
+   each free object, at offset 0 if the cache has no
+   constructor, or just past the object if it does, so that a
+   free object keeps its constructed contents.
+
+   A cache keeps its slabs on three lists: partial, full, and
+   empty.  Allocation takes an object from a partial slab if
+   there is one, otherwise from an empty slab, creating one if
+   necessary.  Freeing an object moves its slab between lists as
+   its use count changes.  A cache holds on to at most
+   MAX_EMPTY_SLABS empty slabs and returns the rest to the page
+   allocator, so memory isn't pinned by a cache after a burst of
+   allocations.
+
+   The slab header's page-aligned address, found from any object
+   with pg_round_down(), leads back to the slab in O(1). */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Number of empty slabs a cache keeps instead of freeing. */
+#define MAX_EMPTY_SLABS 1
+
+/* Slab header, at the start of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem slab_elem; /* Element in one of the cache's lists. */
+    void *free;                 /* First free object, or null. */
+    size_t in_use;              /* Number of objects in use. */
+  };
+
+/* Offset of the first object in a slab. */
+#define SLAB_OBJ_OFS ROUND_UP (sizeof (struct slab), sizeof (void *))
+
+/* All caches, for kmem_cache_print_stats(). */
+static struct list all_caches = LIST_INITIALIZER (all_caches);
+
+static struct slab *slab_create (struct kmem_cache *);
+static void slab_destroy (struct slab *);
+
+/* Returns a pointer to object OBJ's free-list link in cache C. */
+static void **
+obj_link (const struct kmem_cache *c, void *obj)
+{
+  return (void **) ((uint8_t *) obj + c->link_ofs);
+}
+
+/* Initializes C as a cache named NAME of SIZE-byte objects.  If
+   CTOR is nonnull, it is called on each object when its slab is
+   created.  No memory is allocated until the first call to
+   kmem_cache_alloc(), so this may be called before the page
+   allocator is initialized. */
+void
+kmem_cache_init (struct kmem_cache *c, const char *name, size_t size,
+                 kmem_ctor_func *ctor)
+{
+  ASSERT (c != NULL);
+  ASSERT (size > 0);
+
+  c->name = name;
+  c->obj_size = size;
+  c->ctor = ctor;
+  if (ctor == NULL)
+    {
+      c->link_ofs = 0;
+      c->stride = ROUND_UP (size > sizeof (void *) ? size : sizeof (void *),
+                            sizeof (void *));
+    }
+  else
+    {
+      c->link_ofs = ROUND_UP (size, sizeof (void *));
+      c->stride = c->link_ofs + sizeof (void *);
+    }
+  c->objs_per_slab = (PGSIZE - SLAB_OBJ_OFS) / c->stride;
+  if (c->objs_per_slab == 0)
+    PANIC ("%s: %zu-byte objects do not fit in a slab", name, size);
+
+  lock_init (&c->lock);
+  list_init (&c->partial_slabs);
+  list_init (&c->full_slabs);
+  list_init (&c->empty_slabs);
+  c->empty_cnt = 0;
+
+  c->alloc_cnt = c->free_cnt = 0;
+  c->grow_cnt = c->reap_cnt = 0;
+  c->in_use = c->max_in_use = c->slab_cnt = 0;
+
+  list_push_back (&all_caches, &c->cache_elem);
+}
+
+/* Obtains and returns an object from cache C.  Returns a null
+   pointer if memory is not available.  The object's contents
+   are those left by its constructor, or by its last user,
+   or are arbitrary if C has no constructor. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+
+  /* Find a slab with a free object. */
+  if (!list_empty (&c->partial_slabs))
+    s = list_entry (list_front (&c->partial_slabs), struct slab, slab_elem);
+  else if (!list_empty (&c->empty_slabs))
+    {
+      s = list_entry (list_pop_front (&c->empty_slabs),
+                      struct slab, slab_elem);
+      c->empty_cnt--;
+      list_push_front (&c->partial_slabs, &s->slab_elem);
+    }
+  else
+    {
+      s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_front (&c->partial_slabs, &s->slab_elem);
+    }
+
+  /* Take its first free object. */
+  obj = s->free;
+  ASSERT (obj != NULL);
+  s->free = *obj_link (c, obj);
+  if (++s->in_use == c->objs_per_slab)
+    {
+      list_remove (&s->slab_elem);
+      list_push_front (&c->full_slabs, &s->slab_elem);
+    }
+
+  c->alloc_cnt++;
+  if (++c->in_use > c->max_in_use)
+    c->max_in_use = c->in_use;
+
+  lock_release (&c->lock);
+#ifdef HEAPPROF
+  heapprof_alloc (__builtin_return_address (0), obj, c->obj_size);
+#endif
+  return obj;
+}
+
+/* Returns OBJ, which must have been obtained from cache C with
+   kmem_cache_alloc(), to C.  If C has a constructor, OBJ must be
+   in its constructed state.  A null OBJ is ignored. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  if (obj == NULL)
+    return;
+
+#ifdef HEAPPROF
+  heapprof_free (obj);
+#endif
+  s = pg_round_down (obj);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  ASSERT (((uint8_t *) obj - (uint8_t *) s - SLAB_OBJ_OFS) % c->stride == 0);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     that would destroy its constructed state. */
+  if (c->ctor == NULL)
+    memset (obj, 0xcc, c->obj_size);
+#endif
+
+  lock_acquire (&c->lock);
+
+  ASSERT (s->in_use > 0);
+  *obj_link (c, obj) = s->free;
+  s->free = obj;
+
+  /* Move the slab to the list that now describes it. */
+  if (s->in_use-- == c->objs_per_slab)
+    {
+      list_remove (&s->slab_elem);
+      list_push_front (&c->partial_slabs, &s->slab_elem);
+    }
+  if (s->in_use == 0)
+    {
+      list_remove (&s->slab_elem);
+      if (c->empty_cnt < MAX_EMPTY_SLABS)
+        {
+          list_push_front (&c->empty_slabs, &s->slab_elem);
+          c->empty_cnt++;
+        }
+      else
+        slab_destroy (s);
+    }
+
+  c->free_cnt++;
+  c->in_use--;
+
+  lock_release (&c->lock);
+}
+
+/* Prints statistics for each cache that has been used. */
+void
+kmem_cache_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, cache_elem);
+      if (c->alloc_cnt == 0)
+        continue;
+      printf ("Slab %s: %zu-byte objects, %zu per slab; "
+              "%llu allocs, %llu frees, %zu in use (peak %zu); "
+              "slabs: %zu held, %llu grown, %llu reaped\n",
+              c->name, c->obj_size, c->objs_per_slab,
+              c->alloc_cnt, c->free_cnt, c->in_use, c->max_in_use,
+              c->slab_cnt, c->grow_cnt, c->reap_cnt);
+    }
+}
+
+/* Obtains a new slab for cache C, with all of its objects free
+   and constructed.  Returns the slab, or a null pointer if no
+   page is available.  C's lock must be held. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s;
+  uint8_t *obj;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->in_use = 0;
+  s->free = NULL;
+
+  /* Chain the objects in address order, last first. */
+  obj = (uint8_t *) s + SLAB_OBJ_OFS + c->objs_per_slab * c->stride;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      obj -= c->stride;
+      if (c->ctor != NULL)
+        c->ctor (obj);
+      *obj_link (c, obj) = s->free;
+      s->free = obj;
+    }
+
+  c->grow_cnt++;
+  c->slab_cnt++;
+  return s;
+}
+
+/* Returns slab S, which must have no objects in use and be on
+   none of its cache's lists, to the page allocator. */
+static void
+slab_destroy (struct slab *s)
+{
+  struct kmem_cache *c = s->cache;
+
+  ASSERT (s->in_use == 0);
+
+  s->magic = 0;
+  c->reap_cnt++;
+  c->slab_cnt--;
+  palloc_free_page (s);
+}
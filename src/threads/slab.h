@@ -0,0 +1,54 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Object caches.
+
+   A cache hands out objects of a single, exact size, carved out
+   of "slabs" of one page each obtained from the kernel pool.
+   This wastes less memory than rounding each object up to a
+   malloc() size class and keeps each cache's traffic off the
+   shared malloc() locks.  See slab.c for details. */
+
+/* Optional object constructor.  Called once on each object when
+   its slab is created, not on every allocation, so an object
+   freed back to the cache must be left in its constructed
+   state. */
+typedef void kmem_ctor_func (void *obj);
+
+/* An object cache. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Object size, as requested. */
+    size_t stride;              /* Bytes between consecutive objects. */
+    size_t link_ofs;            /* Offset of free-list link in object. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    kmem_ctor_func *ctor;       /* Constructor, or null. */
+    struct lock lock;           /* Protects everything below. */
+    struct list partial_slabs;  /* Slabs with some objects in use. */
+    struct list full_slabs;     /* Slabs with every object in use. */
+    struct list empty_slabs;    /* Slabs with no objects in use. */
+    size_t empty_cnt;           /* Number of slabs in empty_slabs. */
+    struct list_elem cache_elem; /* Element in list of all caches. */
+
+    /* Statistics. */
+    unsigned long long alloc_cnt;  /* Objects allocated. */
+    unsigned long long free_cnt;   /* Objects freed. */
+    unsigned long long grow_cnt;   /* Slabs obtained from palloc. */
+    unsigned long long reap_cnt;   /* Slabs returned to palloc. */
+    size_t in_use;                 /* Objects currently allocated. */
+    size_t max_in_use;             /* Peak of in_use. */
+    size_t slab_cnt;               /* Slabs currently held. */
+  };
+
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size,
+                      kmem_ctor_func *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_cache_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -47,22 +47,21 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, less_priority, NULL);
 }
 
 /* Returns true if effective priority of thread a
-   is less than effective priority of thread b. */
+   is less than effective priority of thread b. Waiting threads of
+   equal priority are woken in FIFO order by the heap itself. */
 bool
-less_priority(const struct list_elem *a, 
-              const struct list_elem *b,
+less_priority(const struct heap_elem *a, 
+              const struct heap_elem *b,
               void *aux UNUSED) 
 {
-  struct thread* thread_to_insert = list_entry(a, struct thread, elem);
-  int64_t a_priority =  thread_to_insert->effective_priority;
-  struct thread* thread_in_list = list_entry(b, struct thread, elem);
-  int64_t b_priority =  thread_in_list->effective_priority;
+  struct thread* thread_a = heap_entry(a, struct thread, wait_elem);
+  struct thread* thread_b = heap_entry(b, struct thread, wait_elem);
 
-  return a_priority <= b_priority;
+  return thread_a->effective_priority < thread_b->effective_priority;
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -84,10 +83,7 @@ sema_down (struct semaphore *sema)
   thread_current()->waiting_on_sema = sema;
 
   while (sema->value == 0) {
-    list_insert_ordered(&sema->waiters,
-                        &thread_current()->elem, 
-                        less_priority, 
-                        NULL);
+    heap_insert(&sema->waiters, &thread_current()->wait_elem);
     thread_block();
   }
 
@@ -137,8 +133,9 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
 
-  if (!list_empty (&sema->waiters)) {
-    to_unblock=list_entry(list_pop_back(&sema->waiters),struct thread,elem);
+  if (!heap_empty (&sema->waiters)) {
+    to_unblock=heap_entry(heap_pop_max(&sema->waiters),struct thread,
+                          wait_elem);
     thread_unblock(to_unblock);
   }
 
@@ -297,11 +294,12 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
+/* One semaphore in a condition variable's heap of waiters. */
 struct semaphore_elem
   {
-    struct list_elem elem;              /* List element. */
+    struct heap_elem elem;              /* Heap element. */
     struct semaphore semaphore;         /* This semaphore. */
+    int priority;                       /* Waiter's priority on waiting. */
   };
 
 /* Initializes condition variable COND.  A condition variable
@@ -312,7 +310,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  heap_init (&cond->waiters, less_priority_sema, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -346,8 +344,8 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
 
   sema_init (&waiter.semaphore, 0);
-  list_insert_ordered(&cond->waiters, &waiter.elem,
-    less_priority_sema, &thread_current()->effective_priority);
+  waiter.priority = thread_current()->effective_priority;
+  heap_insert(&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
@@ -368,8 +366,8 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) {
-    sema_up (&list_entry(list_pop_back(&cond->waiters),
+  if (!heap_empty (&cond->waiters)) {
+    sema_up (&heap_entry(heap_pop_max(&cond->waiters),
                          struct semaphore_elem, elem)->semaphore);
   }
 }
@@ -386,26 +384,19 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters)) {
+  while (!heap_empty (&cond->waiters)) {
     cond_signal (cond, lock);    
   }
 }
 
-/* Returns true if effective priority given as argument aux
-   is less than effective priority of semaphore b, which is
-   the highest priority of its waiters. This highest priority
-   element is at the end of the ordered list of waiters. */
+/* Returns true if the thread waiting on semaphore_elem a had a
+   lower priority, when it started waiting, than the thread waiting
+   on semaphore_elem b. */
 bool
-less_priority_sema(const struct list_elem *a UNUSED,
-                   const struct list_elem *b, 
-                   void *aux) 
+less_priority_sema(const struct heap_elem *a,
+                   const struct heap_elem *b, 
+                   void *aux UNUSED) 
 {
-
-  struct semaphore_elem *sema_in_list 
-    = list_entry(b, struct semaphore_elem, elem);
-  int64_t b_priority 
-    = list_entry(list_rbegin(&sema_in_list->semaphore.waiters),
-                            struct thread, elem)->effective_priority;
-
-  return *(int*)aux <= b_priority;
+  return heap_entry(a, struct semaphore_elem, elem)->priority
+         < heap_entry(b, struct semaphore_elem, elem)->priority;
 }
@@ -1,6 +1,7 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
 
@@ -8,10 +9,11 @@
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, highest priority
+                                   first. */
   };
 
-bool less_priority(const struct list_elem *a, const struct list_elem *b,
+bool less_priority(const struct heap_elem *a, const struct heap_elem *b,
     void *aux);
 
 void sema_init (struct semaphore *, unsigned value);
@@ -37,14 +39,15 @@ bool lock_held_by_current_thread (const struct lock *);
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting semaphore_elems. */
+    struct heap waiters;        /* Waiting semaphore_elems, highest
+                                   priority first. */
   };
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
-bool less_priority_sema(const struct list_elem *a, const struct list_elem *b,
+bool less_priority_sema(const struct heap_elem *a, const struct heap_elem *b,
     void *aux);
 
 /* Optimization barrier.
@@ -2,14 +2,17 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "threads/fixed-point.h"
 #include "threads/malloc.h"
@@ -27,32 +30,64 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running.
-   In mlfqs mode, ready_lists_bsd does this, otherwise ready_list
-   will do this this. */
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, are kept in the run queue
+   of the boot CPU, the only one that runs threads (see struct cpu
+   in cpu.h): one FIFO list per priority, used in both scheduling
+   modes, plus a bitmap of the non-empty lists so that the highest
+   ready priority can be found without walking the lists.
 
-/* Array of ready_lists depending on priority for BSD Scheduler */
-static struct list ready_lists_bsd[NUM_PRIORITIES];
-static struct list ready_list;
+   The completely fair scheduler instead keeps the ready
+   threads in a red-black tree ordered by virtual runtime, the CPU
+   time a thread has received scaled down by its weight, and runs
+   the thread that has received the least. */
 
-/* Simply the number of threads in ready_lists_bsd.
+#if NUM_PRIORITIES > 64
+#error ready_lists_bitmap requires NUM_PRIORITIES <= 64
+#endif
+
+/* Simply the number of threads in the ready_lists.
    Needed to calculate load_avg. Only used in mlfqs mode. */
 static int num_of_ready_threads;
 
+/* Lazy recent_cpu decay for the mlfqs scheduler.  Rather than
+   decaying every thread's recent_cpu once a second, which walks
+   all_list with interrupts off, the timer only advances
+   mlfqs_epoch and records that second's decay coefficient.  Each
+   thread folds in the coefficients it missed when it is next
+   looked at (see thread_update_recent_cpu()).  Running and ready
+   threads are still brought up to date every second, as their
+   priorities decide what runs; blocked threads catch up when they
+   are unblocked. */
+#define MLFQS_DECAY_HISTORY 128  /* Seconds of coefficients kept. */
+static unsigned mlfqs_epoch;     /* Seconds since boot. */
+static fixed_point mlfqs_decay[MLFQS_DECAY_HISTORY]; /* Coefficient that
+                                    ended second E, at E % HISTORY. */
+
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* Idle thread. */
-static struct thread *idle_thread;
-
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
+/* Lock used by allocate_tid() and tid_table_reserve(). */
 static struct lock tid_lock;
 
+/* Index of live threads by tid, for tid_to_thread(): an open
+   addressing hash table with linear probing.  Tids are handed out
+   sequentially, so the low bits of a tid make a good hash.  A thread
+   is added by thread_create() and removed by thread_schedule_tail()
+   when its page is freed.  The table starts out in static storage,
+   so that it works before the page allocator does, and doubles in
+   size to keep it at most half full.  Modified and read with
+   interrupts off. */
+#define TID_TABLE_INITIAL_SIZE 256
+static struct thread *tid_table_initial[TID_TABLE_INITIAL_SIZE];
+static struct thread **tid_table = tid_table_initial;
+static size_t tid_table_size = TID_TABLE_INITIAL_SIZE; /* Power of 2. */
+static size_t tid_table_cnt;    /* Slots in use or reserved. */
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame
   {
@@ -75,6 +110,40 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Completely fair scheduler.  A running thread's vruntime advances
+   by CFS_NICE_0_WEIGHT * CFS_TICK_SCALE / weight per tick, so a
+   thread with nice 0 gains CFS_TICK_SCALE per tick and heavier
+   (less nice) threads gain less.  Every ready thread gets a turn
+   within CFS_SCHED_LATENCY ticks, stretched to one minimum
+   granularity per thread when there are too many to fit. */
+#define CFS_NICE_0_WEIGHT 1024  /* Weight of a thread with nice 0. */
+#define CFS_TICK_SCALE 1024     /* vruntime units per nice 0 tick. */
+#define CFS_SCHED_LATENCY (2 * TIME_SLICE)  /* Target period, in ticks. */
+
+/* If true, use the completely fair scheduler.
+   Controlled by kernel command-line option "-cfs". */
+bool thread_cfs;
+
+/* Minimum ticks to run before CFS preemption.
+   Controlled by kernel command-line option "-cfs-gran=TICKS". */
+int thread_cfs_min_granularity = 1;
+
+/* Weight of each nice value from -20 to 20.  Each step of nice is
+   worth about 10% of CPU time against a thread one step away, the
+   same table as the Linux scheduler's, extended to nice 20. */
+static const int cfs_nice_to_weight[41] =
+  {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */  9548,  7620,  6100,  4904,  3906,
+    /*  -5 */  3121,  2501,  1991,  1586,  1277,
+    /*   0 */  1024,   820,   655,   526,   423,
+    /*   5 */   335,   272,   215,   172,   137,
+    /*  10 */   110,    87,    70,    56,    45,
+    /*  15 */    36,    29,    23,    18,    15,
+    /*  20 */    12,
+  };
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -86,8 +155,21 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static bool tid_table_reserve (void);
+static void tid_table_insert (struct thread *);
+static void tid_table_remove (struct thread *);
 
 static int highest_ready_priority(void);
+static int cpu_highest_ready_priority(struct cpu *c);
+static void remove_from_ready_list(struct thread *t);
+static struct thread *cpu_pop_ready(struct cpu *c);
+
+static fixed_point recent_cpu_decay(void);
+static void cpu_update_mlfqs(struct cpu *c);
+
+static int cfs_weight(const struct thread *t);
+static void cfs_update_min_vruntime(struct cpu *c, struct thread *cur);
+static bool cfs_tick(struct thread *cur);
 
 
 /* Initializes the threading system by transforming the code
@@ -109,22 +191,16 @@ thread_init (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  frame_table_init();
-  /* Initialise the 64 queues */
-  if (thread_mlfqs) {
-    int i;
+  page_init();
 
-    for (i = 0; i < (NUM_PRIORITIES); ++i) {
-      list_init(&ready_lists_bsd[i]);
-    }
+  /* Find the CPUs, which also initialises their run queues. */
+  cpu_init();
 
+  if (thread_mlfqs) {
     /* load_avg set to 0 on OS boot. */
     load_avg = 0;
     /* Number of ready threads is set to 0 on boot as well. */
     num_of_ready_threads = 0;
-    
-  } else {
-    list_init (&ready_list);
   }
 
   list_init (&all_list);
@@ -134,6 +210,8 @@ thread_init (void)
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  tid_table_reserve ();
+  tid_table_insert (initial_thread);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -161,7 +239,7 @@ thread_tick (void)
   struct thread *t = thread_current ();
 
   /* Update statistics. */
-  if (t == idle_thread)
+  if (is_idle_thread(t))
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
@@ -170,12 +248,6 @@ thread_tick (void)
   else
     kernel_ticks++;
 
-#ifdef VM
-  if (timer_ticks() % TIME_SLICE == 0) {
-    update_frame_clock_counters();
-  }
-#endif
-
   /* Next if statement deals with updating BSD Scheduler specific data, such as
      recent_cpu. */
   if (thread_mlfqs) {
@@ -187,27 +259,51 @@ thread_tick (void)
         = ADD_INT_AND_FIXED_POINT(1, thread_current()->recent_cpu);
     }
     
-    /* Every second update load_avg and recent_cpu of all threads.
-       Only need to update priority if recent_cpu has changed, which
-       happens every second, or every tick for the current thread.
+    /* Every second update load_avg and start a new epoch, decaying
+       recent_cpu. Only need to update priority if recent_cpu has
+       changed, which happens every second, or every tick for the
+       current thread, and only for threads that can run: the rest
+       are brought up to date by thread_unblock().
        Note, we don't need to worry about the niceness having changed,
        which would mean we have to recalculate priority, because
        thread_set_nice() will automatically recalculate the priority. */
     if (timer_ticks() % TIMER_FREQ == 0) {
       thread_update_load_avg();
-      thread_foreach(thread_update_recent_cpu, NULL);
-      thread_foreach(thread_update_bsd_priority, NULL);
+      mlfqs_decay[mlfqs_epoch % MLFQS_DECAY_HISTORY] = recent_cpu_decay();
+      mlfqs_epoch++;
+
+      thread_update_recent_cpu(cur, NULL);
+      thread_update_bsd_priority(cur, NULL);
+      cpu_update_mlfqs(cur->cpu);
     } else if (timer_ticks() % TIME_SLICE == 0) {
       thread_update_bsd_priority(thread_current(), NULL);
     }
   }
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE) {
+  /* Enforce preemption.  CFS sizes each thread's time slice from
+     the load on its CPU instead of using a fixed TIME_SLICE; the
+     idle thread is not in the run queue and keeps the fixed slice. */
+  if (thread_cfs && !is_idle_thread(t)) {
+    if (cfs_tick(t)) {
+      intr_yield_on_return ();
+    }
+  } else if (++thread_ticks >= TIME_SLICE) {
     intr_yield_on_return ();
   }
 }
 
+/* Called by the timer for TICKS timer ticks that passed without a
+   timer interrupt because the idle thread stopped the periodic tick
+   (see timer_idle_enter()).  The idle thread was running for all of
+   them, so there is nothing to do beyond keeping the statistics. */
+void
+thread_tick_idle (int64_t ticks)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  idle_ticks += ticks;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void)
@@ -251,9 +347,17 @@ thread_create (const char *name, int priority,
     return TID_ERROR;
   }
 
+  /* Make room for the thread in tid_table. */
+  if (!tid_table_reserve ()) {
+    palloc_free_page (t);
+    return TID_ERROR;
+  }
+
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  tid_table_insert (t);
+  trace_thread_name (t);
 
 #ifdef VM
   /* Initialise supplemental page table. */
@@ -337,11 +441,29 @@ thread_unblock (struct thread *t)
 
   if (thread_mlfqs) {
     num_of_ready_threads++;
+
+    /* Fold in the recent_cpu decay T missed while blocked. */
+    thread_update_recent_cpu(t, NULL);
+    thread_update_bsd_priority(t, NULL);
+  }
+
+  /* A thread that slept keeps the vruntime it had, so that it runs
+     soon after waking, but only up to half a period's worth of
+     credit: otherwise a long sleeper could hog the CPU until it
+     caught up with everyone else.  New threads start out here
+     too, as their vruntime is 0. */
+  if (thread_cfs) {
+    int64_t floor = t->cpu->min_vruntime
+                    - CFS_SCHED_LATENCY * CFS_TICK_SCALE / 2;
+    if (t->vruntime < floor) {
+      t->vruntime = floor;
+    }
   }
 
   add_to_ready_list(t);
 
   t->status = THREAD_READY;
+  trace_event (TRACE_WAKEUP, t->tid, running_thread ()->tid, intr_context ());
   intr_set_level (old_level);
 }
 
@@ -410,15 +532,84 @@ thread_exit (void)
   NOT_REACHED ();
 }
 
-/* Add t to the relevant ready_list - if using priority scheduling,
-   that's easy but it's a little more complex with 4.4BSD scheduling. */
+/* Add t to the back of the ready list for its effective priority on
+   t's CPU, and mark that priority as occupied in the CPU's
+   ready_lists_bitmap. Under CFS, add t to the CPU's cfs_tree
+   instead. */
 void add_to_ready_list(struct thread *t) 
 {
-  if (thread_mlfqs) {
-    list_push_front(&ready_lists_bsd[t->effective_priority-PRI_MIN], &t->elem);
+  struct cpu *c = t->cpu;
+  int index = t->effective_priority - PRI_MIN;
+  enum intr_level old_level = intr_disable();
+
+  if (thread_cfs) {
+    rb_insert(&c->cfs_tree, &t->cfs_elem);
+    c->cfs_load += cfs_weight(t);
   } else {
-    list_insert_ordered(&ready_list, &t->elem, less_priority, NULL);
+    list_push_back(&c->ready_lists[index], &t->elem);
+    c->ready_lists_bitmap |= (uint64_t) 1 << index;
+  }
+  c->ready_cnt++;
+
+  intr_set_level(old_level);
+}
+
+/* Remove t from the ready list for its effective priority on t's CPU,
+   clearing that priority's bit if the list is now empty. Must be called
+   before t's effective priority is changed. */
+static void
+remove_from_ready_list(struct thread *t)
+{
+  struct cpu *c = t->cpu;
+  int index = t->effective_priority - PRI_MIN;
+  enum intr_level old_level = intr_disable();
+
+  if (thread_cfs) {
+    rb_remove(&c->cfs_tree, &t->cfs_elem);
+    c->cfs_load -= cfs_weight(t);
+  } else {
+    list_remove(&t->elem);
+    if (list_empty(&c->ready_lists[index])) {
+      c->ready_lists_bitmap &= ~((uint64_t) 1 << index);
+    }
+  }
+  c->ready_cnt--;
+
+  intr_set_level(old_level);
+}
+
+/* Removes and returns the first thread of the highest priority
+   non-empty ready list of C, or under CFS the thread with the least
+   vruntime, or returns NULL if C has no ready threads. Interrupts
+   must be off. */
+static struct thread *
+cpu_pop_ready(struct cpu *c)
+{
+  struct thread *t = NULL;
+  int priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_cfs) {
+    struct rb_elem *e = rb_min(&c->cfs_tree);
+
+    if (e != NULL) {
+      t = rb_entry(e, struct thread, cfs_elem);
+      rb_remove(&c->cfs_tree, e);
+      c->cfs_load -= cfs_weight(t);
+      c->ready_cnt--;
+    }
+  } else if ((priority = cpu_highest_ready_priority(c)) >= 0) {
+    struct list *list = &c->ready_lists[priority - PRI_MIN];
+
+    t = list_entry(list_pop_front(list), struct thread, elem);
+    if (list_empty(list)) {
+      c->ready_lists_bitmap &= ~((uint64_t) 1 << (priority - PRI_MIN));
+    }
+    c->ready_cnt--;
   }
+
+  return t;
 }
 
 /* Yields the CPU.  The current thread is not put to sleep and
@@ -433,7 +624,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
 
-  if (cur != idle_thread) {
+  if (!is_idle_thread(cur)) {
     add_to_ready_list(cur);
   }
 
@@ -488,15 +679,11 @@ thread_set_priority (int new_priority)
 
   /* Check if we need to yield to let the new thread immediately
      start running. */
-  if (!list_empty(&ready_list)) {
-    struct thread *next_to_run 
-      = list_entry(list_rbegin(&ready_list), struct thread, elem);
-    if (next_to_run->effective_priority > new_priority) {
-      if (intr_context()) {
-        intr_yield_on_return();
-      } else {
-        thread_yield();
-      }
+  if (highest_ready_priority() > new_priority) {
+    if (intr_context()) {
+      intr_yield_on_return();
+    } else {
+      thread_yield();
     }
   }
 }
@@ -508,23 +695,24 @@ thread_donate_priority (struct thread *t, int priority)
     return;
   }
 
-  t->effective_priority = priority;
+  trace_event(TRACE_DONATE, t->tid, thread_current()->tid, priority);
 
-  /* If we change the priority of an element in an ordered list, we
-     need to remove that element and then reinsert it in the new correct
-     position in the list, so that the list is still ordered. */
+  /* A ready thread must leave its old priority's ready list before
+     its priority changes. A thread waiting on a semaphore only moves
+     up in the semaphore's heap of waiters, which is done in place. */
 
-  if (t->status == THREAD_BLOCKED) {
-    ASSERT(!list_empty(&t->waiting_on_sema->waiters));
+  if (t->status == THREAD_READY) {
+    remove_from_ready_list(t);
+    t->effective_priority = priority;
+    add_to_ready_list(t);
+  } else {
+    t->effective_priority = priority;
 
-    list_remove(&t->elem);
-    list_insert_ordered(&t->waiting_on_sema->waiters, &t->elem,
-        less_priority, NULL);
-  } else if (t->status == THREAD_READY) {
-    ASSERT(!list_empty(&ready_list));
+    if (t->status == THREAD_BLOCKED && t->waiting_on_sema != NULL) {
+      ASSERT(!heap_empty(&t->waiting_on_sema->waiters));
 
-    list_remove(&t->elem);
-    add_to_ready_list(t);
+      heap_increase(&t->waiting_on_sema->waiters, &t->wait_elem);
+    }
   }
 
   /* If the thread we are donating to is also waiting on a lock, we can
@@ -559,9 +747,9 @@ thread_recalculate_effective_priority(struct thread *t)
 
     struct lock *lock = list_entry(e, struct lock, lock_elem);
 
-    if (!list_empty(&lock->semaphore.waiters)) {
-      int local_max = list_entry(list_rbegin(&lock->semaphore.waiters),
-                                 struct thread, elem)->effective_priority;
+    if (!heap_empty(&lock->semaphore.waiters)) {
+      int local_max = heap_entry(heap_max(&lock->semaphore.waiters),
+                                 struct thread, wait_elem)->effective_priority;
 
       if (local_max > max) {
         max = local_max;
@@ -591,10 +779,18 @@ thread_set_nice (int nice)
   struct thread *t = thread_current();
   t->nice = nice;
   /* Must update a threads priority when setting its nice value. */
-  thread_update_bsd_priority(t, NULL);
+  if (thread_mlfqs) {
+    thread_update_bsd_priority(t, NULL);
+  }
 
   intr_set_level(old_level);
 
+  /* Under CFS the running thread's new weight is picked up by
+     thread_tick(). */
+  if (thread_cfs) {
+    return;
+  }
+
   /* Yield if not highest priority */
   if (thread_get_priority() < highest_ready_priority()) {
     if (!intr_context()){
@@ -647,13 +843,20 @@ thread_update_bsd_priority (struct thread *t, void *aux UNUSED)
 {
   ASSERT (thread_mlfqs);
 
-  t->effective_priority = thread_calculate_bsd_priority(t->recent_cpu, t->nice);
+  int priority = thread_calculate_bsd_priority(t->recent_cpu, t->nice);
+
+  if (priority == t->effective_priority) {
+    return;
+  }
 
   /* If a threads priority changes in mlfqs mode, we need to move it
-     to a different priority queue in ready_lists_bsd. */
+     to a different priority queue in ready_lists. */
   if (!is_idle_thread(t) && t->status == THREAD_READY) {
-    list_remove(&t->elem);
+    remove_from_ready_list(t);
+    t->effective_priority = priority;
     add_to_ready_list(t);
+  } else {
+    t->effective_priority = priority;
   }
 }
 
@@ -671,6 +874,20 @@ thread_get_recent_cpu (void)
 
 fixed_point
 thread_calculate_recent_cpu(fixed_point recent_cpu, int thread_nice) 
+{
+  fixed_point lavg_cpu_mult
+      = MUL_FIXED_POINTS(recent_cpu_decay(), recent_cpu);
+
+  fixed_point rcpu
+      = ADD_INT_AND_FIXED_POINT(thread_nice, lavg_cpu_mult);
+
+  return rcpu;
+}
+
+/* Returns the recent_cpu decay coefficient for the current load_avg,
+   (2*load_avg)/(2*load_avg + 1). */
+static fixed_point
+recent_cpu_decay(void)
 {
   fixed_point lavg_part_numerator
       = MUL_INT_AND_FIXED_POINT(2, load_avg);
@@ -678,24 +895,82 @@ thread_calculate_recent_cpu(fixed_point recent_cpu, int thread_nice)
   fixed_point lavg_part_denominator
       = ADD_INT_AND_FIXED_POINT(1, lavg_part_numerator);
 
-  fixed_point lavg_part_fraction
-      = DIV_FIXED_POINTS(lavg_part_numerator, lavg_part_denominator);
+  return DIV_FIXED_POINTS(lavg_part_numerator, lavg_part_denominator);
+}
 
-  fixed_point lavg_cpu_mult
-      = MUL_FIXED_POINTS(lavg_part_fraction, recent_cpu);
+/* Brings thread cur's recent_cpu value up to date, applying the decay
+   of every second that has ended since it was last updated, each with
+   that second's load_avg. Calling it again in the same second does
+   nothing. Must be called with interrupts off. */
+void
+thread_update_recent_cpu(struct thread *cur, void *aux UNUSED) 
+{
+  unsigned missed;
 
-  fixed_point rcpu
-      = ADD_INT_AND_FIXED_POINT(thread_nice, lavg_cpu_mult);
+  ASSERT (intr_get_level () == INTR_OFF);
 
-  return rcpu;
+  if (is_idle_thread(cur)) {
+    return;
+  }
+
+  /* Coefficients older than the history are gone. Approximate them
+     with the oldest one kept, applied at most MLFQS_DECAY_HISTORY
+     times, by which point recent_cpu has long since converged. */
+  missed = mlfqs_epoch - cur->recent_cpu_epoch;
+  if (missed > MLFQS_DECAY_HISTORY) {
+    fixed_point oldest
+        = mlfqs_decay[mlfqs_epoch % MLFQS_DECAY_HISTORY];
+    unsigned i;
+
+    for (i = MLFQS_DECAY_HISTORY;
+         i < missed && i < 2 * MLFQS_DECAY_HISTORY; i++) {
+      cur->recent_cpu = ADD_INT_AND_FIXED_POINT(cur->nice,
+          MUL_FIXED_POINTS(oldest, cur->recent_cpu));
+    }
+    cur->recent_cpu_epoch = mlfqs_epoch - MLFQS_DECAY_HISTORY;
+  }
+
+  for (; cur->recent_cpu_epoch != mlfqs_epoch; cur->recent_cpu_epoch++) {
+    fixed_point decay
+        = mlfqs_decay[cur->recent_cpu_epoch % MLFQS_DECAY_HISTORY];
+    cur->recent_cpu = ADD_INT_AND_FIXED_POINT(cur->nice,
+        MUL_FIXED_POINTS(decay, cur->recent_cpu));
+  }
 }
 
-/* Updates current thread's recent_cpu value. */
-void
-thread_update_recent_cpu(struct thread *cur, void *aux UNUSED) 
+/* Brings the recent_cpu and priority of every thread ready on C up to
+   date for a new second, moving those whose priority changed to the
+   back of their new priority's ready list. Interrupts must be off. */
+static void
+cpu_update_mlfqs(struct cpu *c)
 {
-  if (!is_idle_thread(cur)) {
-    cur->recent_cpu = thread_calculate_recent_cpu(cur->recent_cpu, cur->nice);
+  int index;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (index = 0; index < NUM_PRIORITIES; index++) {
+    struct list *list = &c->ready_lists[index];
+    struct list_elem *e, *next;
+
+    /* A thread moved to a list not yet visited is up to date when
+       reached again, so it does not move twice. */
+    for (e = list_begin(list); e != list_end(list); e = next) {
+      struct thread *t = list_entry(e, struct thread, elem);
+      int priority;
+
+      next = list_next(e);
+      thread_update_recent_cpu(t, NULL);
+      priority = thread_calculate_bsd_priority(t->recent_cpu, t->nice);
+      if (priority != t->effective_priority) {
+        list_remove(e);
+        t->effective_priority = priority;
+        list_push_back(&c->ready_lists[priority - PRI_MIN], e);
+        c->ready_lists_bitmap |= (uint64_t) 1 << (priority - PRI_MIN);
+      }
+    }
+    if (list_empty(list)) {
+      c->ready_lists_bitmap &= ~((uint64_t) 1 << index);
+    }
   }
 }
 
@@ -727,37 +1002,110 @@ thread_update_load_avg(void)
   load_avg = thread_calculate_load_avg(load_avg);
 }
 
-/* Returns highest priority out of all threads that are ready. */
+/* Returns highest priority out of all threads that are ready on the
+   running thread's CPU, or -1 if no threads are ready there. */
 static int 
 highest_ready_priority(void)
 {
-  /* In the advanced scheduler, we must find the highest priority non-empty
-     queue in the array of queues (ready_lists_bsd), and return this priority.
-     Otherwise, we can return the effective priority of the first thread in the
-     ordered ready list. */
-  if (thread_mlfqs) {
+  return cpu_highest_ready_priority(running_thread()->cpu);
+}
 
-    int i;
+/* Returns highest priority out of all threads that are ready on C, or
+   -1 if no threads are ready there. */
+static int
+cpu_highest_ready_priority(struct cpu *c)
+{
+  /* The highest priority non-empty queue is the most significant set bit
+     of ready_lists_bitmap. Split it into halves, as we only have 32-bit
+     bit-scan instructions. */
+  uint64_t bitmap = c->ready_lists_bitmap;
+  uint32_t high = (uint32_t) (bitmap >> 32);
+  uint32_t low = (uint32_t) bitmap;
+
+  if (high != 0) {
+    return 63 - __builtin_clz(high) + PRI_MIN;
+  } else if (low != 0) {
+    return 31 - __builtin_clz(low) + PRI_MIN;
+  }
 
-    for (i = NUM_PRIORITIES - 1; i >= 0; i--) {
-      if (!list_empty(&ready_lists_bsd[i])) {
-        return i + PRI_MIN;
-      }
-    }
-    /* If no threads are ready, return -1. However, this function
-       should not really be called in the case of no threads being ready. */
-    return -1;
+  return -1;
+}
 
-  } else {
-    return (list_entry(list_rbegin(&ready_list),
-                       struct thread, elem)->effective_priority);
+
+
+/* COMPLETELY FAIR SCHEDULER FUNCTIONS: */
+
+/* Returns T's CFS weight, from its nice value. */
+static int
+cfs_weight(const struct thread *t)
+{
+  return cfs_nice_to_weight[t->nice + 20];
+}
+
+/* Advances C's min_vruntime to the least vruntime of CUR, which is
+   running on C, and C's ready threads, if that is greater. It never
+   moves backwards, so that threads placed relative to it are not
+   given more credit than they had. Interrupts must be off. */
+static void
+cfs_update_min_vruntime(struct cpu *c, struct thread *cur)
+{
+  int64_t vruntime = cur->vruntime;
+  struct rb_elem *e = rb_min(&c->cfs_tree);
+
+  if (e != NULL) {
+    int64_t leftmost = rb_entry(e, struct thread, cfs_elem)->vruntime;
+    if (leftmost < vruntime) {
+      vruntime = leftmost;
+    }
   }
 
-  NOT_REACHED();
-  return -1;
+  if (vruntime > c->min_vruntime) {
+    c->min_vruntime = vruntime;
+  }
 }
 
+/* Charges CUR, the running thread, for one more tick under CFS, and
+   returns true if it should now be preempted. It is, once it has run
+   for at least the minimum granularity, if it has used up its share
+   of the scheduling period, or if it has got more than a share's
+   worth of vruntime ahead of the thread with the least. */
+static bool
+cfs_tick(struct thread *cur)
+{
+  struct cpu *c = cur->cpu;
+  struct rb_elem *e;
+  int weight = cfs_weight(cur);
+  int64_t period, slice;
+  bool preempt = false;
+
+  ASSERT (intr_get_level () == INTR_OFF);
 
+  cur->vruntime += CFS_NICE_0_WEIGHT * CFS_TICK_SCALE / weight;
+  thread_ticks++;
+
+  cfs_update_min_vruntime(c, cur);
+
+  e = rb_min(&c->cfs_tree);
+  if (e != NULL && thread_ticks >= (unsigned) thread_cfs_min_granularity) {
+    /* CUR's share of the period, the longer of the target latency
+       and one minimum granularity per runnable thread. */
+    period = (int64_t) (c->ready_cnt + 1) * thread_cfs_min_granularity;
+    if (period < CFS_SCHED_LATENCY) {
+      period = CFS_SCHED_LATENCY;
+    }
+    slice = period * weight / (c->cfs_load + weight);
+
+    if (thread_ticks >= slice) {
+      preempt = true;
+    } else {
+      int64_t lead = cur->vruntime
+                     - rb_entry(e, struct thread, cfs_elem)->vruntime;
+      preempt = lead > slice * CFS_TICK_SCALE;
+    }
+  }
+
+  return preempt;
+}
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
@@ -772,7 +1120,9 @@ static void
 idle (void *idle_started_ UNUSED)
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  struct cpu *c = thread_current ()->cpu;
+
+  c->idle_thread = thread_current ();
   sema_up (idle_started);
 
   for (;;)
@@ -781,6 +1131,23 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nothing else is ready, so zero some free pages for later
+         PAL_ZERO requests.  A thread woken by an interrupt handler
+         meanwhile does not preempt us until the end of the time
+         slice, so stop as soon as one is ready. */
+      intr_enable ();
+      while (c->ready_cnt == 0 && palloc_prezero_page ())
+        continue;
+      intr_disable ();
+
+      /* Don't halt with a thread waiting to run. */
+      if (c->ready_cnt > 0)
+        continue;
+
+      /* Nothing else is ready, so in tickless mode stop the
+         periodic timer interrupt until it is next needed. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -845,6 +1212,9 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
 
+  /* Threads start out on their creator's CPU. */
+  t->cpu = (t == initial_thread) ? cpu_boot () : thread_current ()->cpu;
+
 #ifdef USERPROG
   list_init(&t->children);
   t->waited_on = false;
@@ -884,6 +1254,11 @@ init_thread (struct thread *t, const char *name, int priority)
      reserved for input and output, respectively. */
   t->next_file_descriptor = 2;
 
+  if (thread_cfs && t != initial_thread) {
+    /* Inherit parent's niceness, which sets the CFS weight. */
+    t->nice = thread_get_nice();
+  }
+
   if (thread_mlfqs) {
 
     /* Set initial threads niceness and recent_cpu to 0. */
@@ -895,6 +1270,7 @@ init_thread (struct thread *t, const char *name, int priority)
       /* Inherit parent's niceness and recent CPU */
       t->nice = thread_get_nice();
       t->recent_cpu = thread_current()->recent_cpu;
+      t->recent_cpu_epoch = thread_current()->recent_cpu_epoch;
     }
   }
 
@@ -924,25 +1300,10 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void)
 {
-  if(thread_mlfqs){
-
-    int highest_priority = highest_ready_priority();
+  struct cpu *c = running_thread ()->cpu;
+  struct thread *next = cpu_pop_ready (c);
 
-    if(highest_priority >= 0) {
-      return list_entry(list_pop_back(&ready_lists_bsd[highest_priority]), 
-                                      struct thread, 
-                                      elem);
-    } else {
-      return idle_thread;
-    }
-
-  } else {
-    if (list_empty (&ready_list)){
-      return idle_thread;
-    } else {
-      return list_entry(list_pop_back(&ready_list), struct thread, elem);
-    }
-  }
+  return next != NULL ? next : c->idle_thread;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -984,10 +1345,12 @@ thread_schedule_tail (struct thread *prev)
      pull out the rug under itself.  (We don't free
      initial_thread because its memory was not obtained via
      palloc().) */
-  if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
+  if (prev != NULL && prev->status == THREAD_DYING)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      tid_table_remove (prev);
+      if (prev != initial_thread)
+        palloc_free_page (prev);
     }
 }
 
@@ -1010,7 +1373,10 @@ schedule (void)
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      trace_event (TRACE_SWITCH, cur->tid, next->tid, cur->status);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
@@ -1035,20 +1401,122 @@ uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 /* Returns true if t is the idle thread */
 bool
 is_idle_thread(struct thread *t){
-  return t==idle_thread;
+  return t->cpu != NULL && t == t->cpu->idle_thread;
 }
 
+/* Returns the thread with the given TID, or NULL if there is no
+   such thread, for example because it has exited and been
+   destroyed. Takes constant time on average. */
 struct thread *
 tid_to_thread(tid_t tid) {
-  struct list_elem *e;
-  for (e = list_begin (&all_list);
-       e != list_end (&all_list);
-       e = list_next (e)) {
-    struct thread *t = list_entry (e, struct thread, allelem);
-    if (t->tid == tid) {
-      return t;
+  struct thread *t = NULL;
+  size_t mask = tid_table_size - 1;
+  size_t i;
+  enum intr_level old_level = intr_disable();
+
+  for (i = (size_t) tid & mask; tid_table[i] != NULL; i = (i + 1) & mask) {
+    if (tid_table[i]->tid == tid) {
+      t = tid_table[i];
+      break;
+    }
+  }
+
+  intr_set_level(old_level);
+  return t;
+}
+
+/* Reserves a slot in tid_table for a thread about to be created,
+   first doubling the table if it would be over half full. Returns
+   false if memory for a bigger table is not available. */
+static bool
+tid_table_reserve (void)
+{
+  enum intr_level old_level;
+
+  lock_acquire (&tid_lock);
+  if ((tid_table_cnt + 1) * 2 > tid_table_size) {
+    size_t old_size = tid_table_size;
+    size_t new_size = old_size * 2;
+    size_t page_cnt = DIV_ROUND_UP (new_size * sizeof *tid_table, PGSIZE);
+    struct thread **old_table = tid_table;
+    struct thread **new_table = palloc_get_multiple (PAL_ZERO, page_cnt);
+    size_t i;
+
+    if (new_table == NULL) {
+      lock_release (&tid_lock);
+      return false;
+    }
+
+    /* Rehash with interrupts off, as lookups and removals do not take
+       tid_lock. */
+    old_level = intr_disable ();
+    tid_table = new_table;
+    tid_table_size = new_size;
+    for (i = 0; i < old_size; i++) {
+      if (old_table[i] != NULL) {
+        tid_table_insert (old_table[i]);
+      }
+    }
+    intr_set_level (old_level);
+
+    if (old_table != tid_table_initial) {
+      palloc_free_multiple (old_table,
+                            DIV_ROUND_UP (old_size * sizeof *tid_table,
+                                          PGSIZE));
+    }
+  }
+
+  old_level = intr_disable ();
+  tid_table_cnt++;
+  intr_set_level (old_level);
+  lock_release (&tid_lock);
+
+  return true;
+}
+
+/* Adds T, which must have a slot reserved by tid_table_reserve(), to
+   tid_table. */
+static void
+tid_table_insert (struct thread *t)
+{
+  size_t mask = tid_table_size - 1;
+  size_t i;
+  enum intr_level old_level = intr_disable ();
+
+  for (i = (size_t) t->tid & mask; tid_table[i] != NULL; i = (i + 1) & mask)
+    continue;
+  tid_table[i] = t;
+
+  intr_set_level (old_level);
+}
+
+/* Removes T from tid_table, releasing its slot. Later entries in T's
+   probe sequence are shifted back into the hole, so that lookups can
+   keep stopping at the first empty slot. Interrupts must be off. */
+static void
+tid_table_remove (struct thread *t)
+{
+  size_t mask = tid_table_size - 1;
+  size_t hole, i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (hole = (size_t) t->tid & mask; tid_table[hole] != t;
+       hole = (hole + 1) & mask)
+    ASSERT (tid_table[hole] != NULL);
+  tid_table[hole] = NULL;
+  tid_table_cnt--;
+
+  for (i = (hole + 1) & mask; tid_table[i] != NULL; i = (i + 1) & mask) {
+    size_t home = (size_t) tid_table[i]->tid & mask;
+
+    /* Move the entry at I into the hole unless its home slot lies
+       cyclically in (HOLE, I], where it would no longer be found. */
+    if ((i > hole && (home <= hole || home > i))
+        || (i < hole && home <= hole && home > i)) {
+      tid_table[hole] = tid_table[i];
+      tid_table[i] = NULL;
+      hole = i;
     }
   }
-  NOT_REACHED();
-  return NULL;
 }
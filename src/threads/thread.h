@@ -3,9 +3,11 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
 #include <threads/synch.h>
 #include "fixed-point.h"
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "vm/mmap.h"
 #include "vm/page.h"
@@ -19,6 +21,8 @@ enum thread_status
     THREAD_DYING        /* About to be destroyed. */
   };
 
+struct cpu;
+
 /* Thread identifier type.
    You can redefine this to whatever type you like. */
 typedef int tid_t;
@@ -95,12 +99,10 @@ typedef int tid_t;
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member is an element in the run queue (thread.c).
+   A thread waiting on a semaphore is instead kept in the
+   semaphore's heap of waiters (synch.c) through `wait_elem', which
+   lets a donation move it up the heap in place. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -110,14 +112,20 @@ struct thread
     uint8_t *stack;                    /* Saved stack pointer. */
     int base_priority;                 /* Base priority. */
     int effective_priority;          /* Used in both default and mlfqs mode. */
+    struct cpu *cpu;                   /* CPU running the thread, or whose
+                                          run queue holds it. */
     struct list_elem allelem;          /* List element for all threads list. */
+    struct rb_elem cfs_elem;           /* Element in a CFS run queue. */
+    int64_t vruntime;                  /* CFS weighted virtual runtime. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;             /* List element. */
+    struct heap_elem wait_elem;        /* Element in a semaphore's heap
+                                          of waiters. */
 
     struct semaphore timer_wait_sema;  /* Semaphore to make the thread wait. */
 
-    struct list_elem sleep_elem;       /* list_elem for sleeping threads. */
+    struct timer_event sleep_event;    /* Wakes the thread from timer_sleep(). */
     int64_t ticks_to_wake_on;
 
     struct list locks_holding;  /* List of locks that the thread is holding. */
@@ -127,6 +135,8 @@ struct thread
 
     int nice;                          /* Thread niceness value */
     fixed_point recent_cpu;            /* CPU time recently received */
+    unsigned recent_cpu_epoch;         /* Second recent_cpu is up to date
+                                          for.  See thread_update_recent_cpu(). */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -200,12 +210,24 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler, which ignores
+   priorities and shares the CPU between ready threads in
+   proportion to weights derived from their nice values.
+   Controlled by kernel command-line option "-cfs". */
+extern bool thread_cfs;
+
+/* Minimum number of ticks a thread runs before the completely fair
+   scheduler preempts it for a thread that has had less CPU time.
+   Controlled by kernel command-line option "-cfs-gran=TICKS". */
+extern int thread_cfs_min_granularity;
+
 fixed_point load_avg;                  /* System-wide load_avg variable. */
 
 void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_tick_idle (int64_t ticks);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -223,6 +245,7 @@ const char *thread_name (void);
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
 
+/* Returns the thread with the given tid, or NULL if none. */
 struct thread *tid_to_thread(tid_t tid);
 
 /* PART 1: Priority scheduling */
@@ -234,9 +257,7 @@ typedef void thread_action_func (struct thread *t, void *aux);
 void thread_foreach (thread_action_func *, void *);
 void thread_set_priority (int);
 
-/* Adds a thread to the appropriate ready-list */
-/* in priority scheduling mode, there's only one,
-   but in mlfqs there are more */
+/* Adds a thread to the ready-list for its effective priority. */
 void add_to_ready_list(struct thread *t);
 
 /* PART 2: BSD Scheduler. */
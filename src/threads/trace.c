@@ -0,0 +1,192 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/vmalloc.h"
+#ifdef FILESYS
+#include "filesys/fsutil.h"
+#endif
+
+/* Trace file format.  The file is a copy of the in-memory buffer:
+   one header sector followed by CPU_CNT rings of RING_EVENTS
+   events each.  The events recorded by CPU I are the last
+   min(HEADS[I], RING_EVENTS) written to ring I, which wraps
+   around; the oldest is at index HEADS[I] % RING_EVENTS once the
+   ring has wrapped. */
+#define TRACE_MAGIC "PINTRACE"
+#define TRACE_VERSION 1
+
+/* Events kept per CPU.  A power of 2. */
+#define TRACE_RING_EVENTS 4096
+
+struct trace_header
+  {
+    char magic[8];              /* TRACE_MAGIC. */
+    uint32_t version;           /* TRACE_VERSION. */
+    uint32_t cpu_cnt;           /* Number of rings. */
+    uint32_t ring_events;       /* Events per ring. */
+    uint32_t event_size;        /* sizeof (struct trace_event). */
+    uint64_t tsc_hz;            /* TSC ticks per second, estimated. */
+    uint32_t heads[CPU_MAX];    /* Events ever written to each ring. */
+    uint8_t pad[BLOCK_SECTOR_SIZE - 32 - 4 * CPU_MAX];
+  };
+
+/* Trace scheduler events?
+   Controlled by kernel command-line option "-trace=sched". */
+bool trace_sched;
+
+/* Trace buffer: header, then the rings.  Null until trace_init()
+   allocates it, so events before then are dropped. */
+static struct trace_header *trace_buffer;
+
+/* Time at trace_init(), for estimating the TSC frequency. */
+static uint64_t start_tsc;
+static int64_t start_ticks;
+
+/* Reads the time stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Returns the ring for CPU C. */
+static inline struct trace_event *
+cpu_ring (const struct cpu *c)
+{
+  return (struct trace_event *) (trace_buffer + 1) + c->id * TRACE_RING_EVENTS;
+}
+
+static void name_thread (struct thread *, void *aux);
+
+/* Allocates the trace buffer if tracing was requested, and
+   records the names of the threads that already exist.  Must be
+   called after vmalloc_init(). */
+void
+trace_init (void)
+{
+  struct trace_header *h;
+  enum intr_level old_level;
+  size_t size;
+
+  ASSERT (sizeof *h == BLOCK_SECTOR_SIZE);
+
+  if (!trace_sched)
+    return;
+
+  size = sizeof *h + cpu_cnt * TRACE_RING_EVENTS * sizeof (struct trace_event);
+  h = vmalloc (size);
+  if (h == NULL)
+    {
+      printf ("trace: not enough memory for trace buffer\n");
+      return;
+    }
+  memset (h, 0, size);
+  memcpy (h->magic, TRACE_MAGIC, sizeof h->magic);
+  h->version = TRACE_VERSION;
+  h->cpu_cnt = cpu_cnt;
+  h->ring_events = TRACE_RING_EVENTS;
+  h->event_size = sizeof (struct trace_event);
+
+  old_level = intr_disable ();
+  start_tsc = rdtsc ();
+  start_ticks = timer_ticks ();
+  trace_buffer = h;
+  thread_foreach (name_thread, NULL);
+  intr_set_level (old_level);
+}
+
+/* Records an event of the given TYPE about thread TID, with
+   arguments ARG0 and ARG1, in the running CPU's ring.  The ring
+   is written only by its own CPU, with interrupts off, so no lock
+   is needed. */
+void
+trace_event (enum trace_type type, tid_t tid, int32_t arg0, int32_t arg1)
+{
+  struct trace_event *e;
+  struct cpu *c;
+  enum intr_level old_level;
+
+  if (trace_buffer == NULL)
+    return;
+
+  old_level = intr_disable ();
+  c = cpu_current ();
+  e = &cpu_ring (c)[trace_buffer->heads[c->id]++ % TRACE_RING_EVENTS];
+  e->tsc = rdtsc ();
+  e->type = type;
+  e->cpu = c->id;
+  e->tid = tid;
+  e->data.args[0] = arg0;
+  e->data.args[1] = arg1;
+  e->data.args[2] = e->data.args[3] = 0;
+  intr_set_level (old_level);
+}
+
+/* Records T's name, so that the decoder can show it. */
+void
+trace_thread_name (const struct thread *t)
+{
+  struct trace_event *e;
+  struct cpu *c;
+  enum intr_level old_level;
+
+  if (trace_buffer == NULL)
+    return;
+
+  old_level = intr_disable ();
+  c = cpu_current ();
+  e = &cpu_ring (c)[trace_buffer->heads[c->id]++ % TRACE_RING_EVENTS];
+  e->tsc = rdtsc ();
+  e->type = TRACE_NAME;
+  e->cpu = c->id;
+  e->tid = t->tid;
+  strlcpy (e->data.name, t->name, sizeof e->data.name);
+  intr_set_level (old_level);
+}
+
+/* Thread action for trace_init(). */
+static void
+name_thread (struct thread *t, void *aux UNUSED)
+{
+  trace_thread_name (t);
+}
+
+/* Stops tracing and writes the trace to the scratch device as
+   "sched.trace".  Must be called with interrupts on, outside
+   interrupt context, as it does disk I/O. */
+void
+trace_dump (void)
+{
+  struct trace_header *h = trace_buffer;
+  enum intr_level old_level;
+  int64_t ticks;
+
+  if (h == NULL)
+    return;
+
+  old_level = intr_disable ();
+  trace_buffer = NULL;
+  ticks = timer_ticks () - start_ticks;
+  if (ticks > 0)
+    h->tsc_hz = (rdtsc () - start_tsc) * TIMER_FREQ / ticks;
+  intr_set_level (old_level);
+
+#ifdef FILESYS
+  if (block_get_role (BLOCK_SCRATCH) != NULL)
+    fsutil_append_buffer ("sched.trace", h,
+                          sizeof *h + h->cpu_cnt * TRACE_RING_EVENTS
+                          * sizeof (struct trace_event));
+  else
+    printf ("trace: no scratch device, discarding trace\n");
+#else
+  printf ("trace: no scratch device, discarding trace\n");
+#endif
+  vfree (h);
+}
@@ -0,0 +1,55 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+/* Scheduler event tracing.
+
+   With the "-trace=sched" kernel command-line option, scheduler
+   events are recorded, with time stamp counter (TSC) times, in a
+   ring buffer per CPU.  At shutdown the buffers are written to
+   the scratch device as a file named "sched.trace" in the same
+   ustar format as the `append' action.  The "pintos" script
+   fetches the file with --trace=FILE, and utils/pintos-trace
+   decodes it into per-thread latency histograms. */
+
+/* Types of trace events. */
+enum trace_type
+  {
+    TRACE_SWITCH,       /* schedule(): TID switched to ARG0; ARG1 is
+                           TID's new thread_status. */
+    TRACE_WAKEUP,       /* thread_unblock(): TID woken by ARG0, from an
+                           interrupt handler if ARG1 is nonzero. */
+    TRACE_DONATE,       /* Priority donation: TID given priority ARG1
+                           by ARG0. */
+    TRACE_SLEEP,        /* timer_sleep(): TID sleeps for ARG0 ticks. */
+    TRACE_NAME          /* TID is named NAME. */
+  };
+
+/* A trace event, as stored in memory and in the trace file. */
+struct trace_event
+  {
+    uint64_t tsc;               /* Time stamp counter. */
+    uint16_t type;              /* One of enum trace_type. */
+    uint16_t cpu;               /* CPU that recorded the event. */
+    int32_t tid;                /* Thread the event is about. */
+    union
+      {
+        int32_t args[4];        /* Type-specific arguments. */
+        char name[16];          /* Thread name, for TRACE_NAME. */
+      }
+    data;
+  };
+
+/* Trace scheduler events?
+   Controlled by kernel command-line option "-trace=sched". */
+extern bool trace_sched;
+
+void trace_init (void);
+void trace_event (enum trace_type, tid_t, int32_t arg0, int32_t arg1);
+void trace_thread_name (const struct thread *);
+void trace_dump (void);
+
+#endif /* threads/trace.h */
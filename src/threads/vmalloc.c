@@ -0,0 +1,177 @@
+#include "threads/vmalloc.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdint.h>
+#include "threads/init.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Virtually contiguous allocator.
+
+   The range VMALLOC_START...VMALLOC_END is divided into pages,
+   tracked by a bitmap.  vmalloc() finds a run of free pages in
+   the range, then obtains one page from the kernel pool for each
+   and maps it there.  Each allocation is followed by an unmapped
+   guard page, so that running off the end of a buffer faults
+   instead of silently corrupting its neighbor.
+
+   The page tables for the whole range are created by
+   vmalloc_init() and never freed.  pagedir_create() copies the
+   kernel's page directory entries from init_page_dir, so this
+   way every process page directory shares the same page tables
+   and sees each mapping as soon as it is made.
+
+   The last page of each allocation is marked with PTE_LAST, one
+   of the PTE bits reserved for the OS, so that vfree() can tell
+   how long the allocation is.
+
+   Only the boot CPU runs, so invalidating the local TLB is
+   enough when a page is unmapped. */
+
+/* Marks the PTE of the last page of an allocation. */
+#define PTE_LAST 0x200
+
+/* Number of pages in the range. */
+#define VMALLOC_PAGES \
+  ((size_t) ((uint8_t *) VMALLOC_END - (uint8_t *) VMALLOC_START) / PGSIZE)
+
+static struct lock vmalloc_lock;      /* Protects vmalloc_map. */
+static struct bitmap *vmalloc_map;    /* One bit per page, true if in use. */
+
+/* Returns a pointer to the page table entry for VADDR, which
+   must be in the vmalloc() range. */
+static uint32_t *
+lookup_pte (const void *vaddr)
+{
+  ASSERT (vaddr >= VMALLOC_START && vaddr < VMALLOC_END);
+  return pde_get_pt (init_page_dir[pd_no (vaddr)]) + pt_no (vaddr);
+}
+
+/* Unmaps the page at VADDR and returns its page table entry. */
+static uint32_t
+unmap_page (void *vaddr)
+{
+  uint32_t *pte = lookup_pte (vaddr);
+  uint32_t old = *pte;
+
+  ASSERT (old & PTE_P);
+  *pte = 0;
+  asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+  return old;
+}
+
+/* Returns the index in vmalloc_map of the page at VADDR. */
+static size_t
+page_idx (const void *vaddr)
+{
+  return ((const uint8_t *) vaddr - (const uint8_t *) VMALLOC_START) / PGSIZE;
+}
+
+/* Releases PAGE_CNT pages starting at VADDR, plus the guard page
+   that follows them, in vmalloc_map. */
+static void
+release_range (void *vaddr, size_t page_cnt)
+{
+  lock_acquire (&vmalloc_lock);
+  ASSERT (bitmap_all (vmalloc_map, page_idx (vaddr), page_cnt + 1));
+  bitmap_set_multiple (vmalloc_map, page_idx (vaddr), page_cnt + 1, false);
+  lock_release (&vmalloc_lock);
+}
+
+/* Creates the page tables for the vmalloc() range in
+   init_page_dir.  Must be called after malloc_init() and
+   paging_init() and before the first process page directory is
+   created. */
+void
+vmalloc_init (void)
+{
+  uint8_t *vaddr;
+
+  if (init_ram_pages > vtop (VMALLOC_START) / PGSIZE)
+    PANIC ("vmalloc range overlaps the mapping of %"PRIu32" pages of RAM",
+           init_ram_pages);
+
+  for (vaddr = VMALLOC_START; vaddr < (uint8_t *) VMALLOC_END;
+       vaddr += PTSPAN)
+    {
+      uint32_t *pde = init_page_dir + pd_no (vaddr);
+      ASSERT (*pde == 0);
+      *pde = pde_create (palloc_get_page (PAL_ASSERT | PAL_ZERO));
+    }
+
+  lock_init (&vmalloc_lock);
+  vmalloc_map = bitmap_create (VMALLOC_PAGES);
+  if (vmalloc_map == NULL)
+    PANIC ("vmalloc map creation failed");
+}
+
+/* Obtains and returns a new block of at least SIZE bytes, mapped
+   at contiguous kernel virtual addresses but not necessarily
+   physically contiguous.  Returns a null pointer if SIZE is zero
+   or if there is not enough memory or address space.  The block's
+   contents are arbitrary.  Must not be called from an interrupt
+   context. */
+void *
+vmalloc (size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  uint8_t *vaddr;
+  size_t idx, i;
+
+  if (page_cnt == 0)
+    return NULL;
+
+  /* Reserve the pages and a guard page after them. */
+  lock_acquire (&vmalloc_lock);
+  idx = bitmap_scan_and_flip (vmalloc_map, 0, page_cnt + 1, false);
+  lock_release (&vmalloc_lock);
+  if (idx == BITMAP_ERROR)
+    return NULL;
+  vaddr = (uint8_t *) VMALLOC_START + idx * PGSIZE;
+
+  /* Back them with memory. */
+  for (i = 0; i < page_cnt; i++)
+    {
+      void *page = palloc_get_page (0);
+      if (page == NULL)
+        {
+          while (i-- > 0)
+            palloc_free_page (pte_get_page (unmap_page (vaddr + i * PGSIZE)));
+          release_range (vaddr, page_cnt);
+          return NULL;
+        }
+      *lookup_pte (vaddr + i * PGSIZE) = (pte_create_kernel (page, true)
+                                          | (i == page_cnt - 1 ? PTE_LAST : 0));
+    }
+  return vaddr;
+}
+
+/* Frees block P, which must have been previously allocated with
+   vmalloc().  A null P is ignored. */
+void
+vfree (void *p)
+{
+  uint8_t *vaddr = p;
+  size_t page_cnt;
+  uint32_t pte;
+
+  if (p == NULL)
+    return;
+
+  ASSERT (pg_ofs (p) == 0);
+  ASSERT (p == VMALLOC_START || *lookup_pte (vaddr - PGSIZE) == 0);
+
+  page_cnt = 0;
+  do
+    {
+      pte = unmap_page (vaddr + page_cnt++ * PGSIZE);
+      palloc_free_page (pte_get_page (pte));
+    }
+  while (!(pte & PTE_LAST));
+  release_range (vaddr, page_cnt);
+}
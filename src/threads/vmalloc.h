@@ -0,0 +1,26 @@
+#ifndef THREADS_VMALLOC_H
+#define THREADS_VMALLOC_H
+
+#include <stddef.h>
+
+/* Virtually contiguous kernel allocations.
+
+   vmalloc() builds a buffer out of individually allocated pages
+   from the kernel pool, mapped side by side in a kernel virtual
+   address range above the direct map of physical memory.  Unlike
+   palloc_get_multiple(), it does not need a physically contiguous
+   run of free pages, so large buffers can still be allocated
+   after physical memory has become fragmented.  See vmalloc.c for
+   details. */
+
+/* Kernel virtual addresses reserved for vmalloc(): 32 MB just
+   below the last 4 MB, which holds device registers (see
+   apic.c). */
+#define VMALLOC_END ((void *) 0xffc00000)
+#define VMALLOC_START ((void *) 0xfdc00000)
+
+void vmalloc_init (void);
+void *vmalloc (size_t size);
+void vfree (void *);
+
+#endif /* threads/vmalloc.h */
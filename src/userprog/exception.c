@@ -170,23 +170,33 @@ page_fault (struct intr_frame *f)
      If not, terminate process and free resources. */
   if (entry == NULL)
   {
-    if (should_stack_grow(fault_addr, f->esp)) {
-		  grow_stack(fault_addr);
+    if (should_stack_grow(fault_addr, f->esp) && grow_stack(fault_addr)) {
+		  entry = get_spt_entry(&cur->supp_pt, page_addr);
 	  } else {
 		  cur->exit_status = ERROR;
       sys_exit(ERROR);
 	  }
   }
 
-  /* Obtaining frame to store the page */
-
-  void *kpage = frame_alloc(PAL_USER, page_addr);
+  /* Obtaining frame to store the page. An all-zero page is taken
+     already zeroed, usually from the idle thread's stock. */
+  enum palloc_flags flags = PAL_USER;
+  if (entry != NULL) {
+    /* If the page is being evicted, let it be written out first, so that
+       it is read back from where it went. */
+    frame_wait_evicted(entry);
+  }
+  if (entry != NULL && entry->info == ALL_ZERO) {
+    flags |= PAL_ZERO;
+  }
+  void *kpage = frame_alloc(flags, page_addr);
 
   /* Fetching the data into the frame */
   if (entry != NULL && !entry->in_memory) {
     entry->frame_addr = kpage;
     load_into_page(kpage, entry);
   }
+  frame_unpin(kpage);
 
 }
 
@@ -4,6 +4,7 @@
 #include <string.h>
 #include "threads/init.h"
 #include "threads/pte.h"
+#include "threads/page-copy.h"
 #include "threads/palloc.h"
 
 static uint32_t *active_pd (void);
@@ -18,7 +19,7 @@ pagedir_create (void)
 {
   uint32_t *pd = palloc_get_page (0);
   if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
+    page_copy (pd, init_page_dir);
   return pd;
 }
 
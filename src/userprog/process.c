@@ -330,13 +330,16 @@ process_exit (void)
     struct proc_file* f = list_entry(e, struct proc_file, file_elem);
     file_close(f->file);
     list_remove(&f->file_elem);
-    free(f);
+    kmem_cache_free(&proc_file_cache, f);
   }
   file_close(cur->exec_file);
 #ifdef VM
   /* Frees resources of all entries in the mmap_table, as well as freeing the
      memory allocated for the table itself. */
   hash_destroy(&cur->mmap_table, munmap_exiting);
+  /* Stop the process's frames being evicted before freeing the state that
+     eviction needs. */
+  frame_forget_owner((pid_t) cur->tid);
   /* Free process resources and destroy its supplemental page table. */
   spt_destroy(&cur->supp_pt);
 #endif
@@ -672,13 +675,16 @@ setup_stack (void **esp)
   uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
 
   kpage = frame_alloc(PAL_USER | PAL_ZERO, upage);
-  struct spt_entry *entry = malloc(sizeof(struct spt_entry));
+  struct spt_entry *entry = kmem_cache_alloc(&spt_entry_cache);
   if (entry == NULL) {
     return false;
   }
   entry->info = ALL_ZERO;
   entry->vaddr = upage;
+  entry->swap_slot = NO_SWAP_SLOT;
   entry->frame_addr = kpage;
+  entry->in_memory = true;
+  entry->file_info.writable = true;
   struct thread *t = thread_current();
   struct hash_elem *elem = hash_insert(&t->supp_pt, &entry->elem);
   if (kpage != NULL) 
@@ -687,6 +693,7 @@ setup_stack (void **esp)
       if (success) 
       {
         *esp = PHYS_BASE;
+        frame_unpin(kpage);
       }
       else
         frame_free(kpage);
@@ -9,13 +9,17 @@
 #include "userprog/pagedir.h"
 #include "devices/shutdown.h"
 #include "devices/input.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "lib/string.h"
 #include "vm/page.h"
+#include "vm/frame.h"
 
 /* Ensures multiple threads cannot call file system code at the same time. */
 struct lock secure_file;
 
+/* Cache of struct proc_files, for every process' open files. */
+struct kmem_cache proc_file_cache;
+
 static void syscall_handler (struct intr_frame *);
 static void sys_halt(void);
 static pid_t sys_exec(const char *cmd_line);
@@ -45,6 +49,9 @@ void
 syscall_init (void) 
 {
   lock_init(&secure_file);
+  kmem_cache_init(&proc_file_cache, "proc_file", sizeof(struct proc_file),
+                  NULL);
+  mmap_init();
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -228,6 +235,13 @@ sys_exec(const char *cmd_line)
   struct thread *child = tid_to_thread((tid_t)pid);
   intr_set_level(old_level);
 
+  /* The child cannot be destroyed before we wait on it, but check
+     rather than dereference a null pointer. */
+  if (child == NULL) {
+    lock_release(&secure_file);
+    return PID_ERROR;
+  }
+
   sema_down(&child->load_sema);
   lock_release(&secure_file);
 
@@ -299,7 +313,7 @@ sys_open(const char *file)
 
   struct thread *t = thread_current();
   /* Freed in sys_close(). */
-  struct proc_file *f = malloc(sizeof(struct proc_file));
+  struct proc_file *f = kmem_cache_alloc(&proc_file_cache);
 
   if (f == NULL)
     sys_exit(FD_ERROR);
@@ -503,7 +517,7 @@ sys_close(int fd)
     {
       file_close(f->file);
       list_remove(&f->file_elem);
-      free(f);
+      kmem_cache_free(&proc_file_cache, f);
       break;
     }
   }
@@ -614,7 +628,7 @@ sys_mmap(int fd, void *addr)
   lock_release(&cur->mmap_table_lock);
 
   /* Return -1 if mmap_table_insert wasn't successful (meaning there isn't
-     enough space to malloc for a struct mmap_mapping *). */
+     enough memory for a struct mmap_mapping). */
   if (!success) {
     return ERROR;
   }
@@ -670,50 +684,30 @@ munmap_exiting(struct hash_elem *e, void *aux UNUSED) {
 }
 
 /* Removes all pages in the given MMAP mapping from the current process' list
-   of virtual pages - the supplmentary page table. Also, each page that has
-   been written to by the current process must be written back to the file.
-   Called by sys_munmap() and munmap_exiting(). */
+   of virtual pages - the supplmentary page table. Also, each page in memory
+   that has been written to by the current process is written back to the
+   file, and its frame is freed. Called by sys_munmap() and
+   munmap_exiting(). */
 static void
 pages_munmap(struct mmap_mapping *mmap) {
   struct thread *cur = thread_current();
   struct hash *spt = &cur->supp_pt;
   void *page_uaddr = mmap->start_uaddr;
   int num_pages = mmap->num_pages;
-  uint32_t *pd = cur->pagedir;
-  struct file *file = mmap->file;
-
-  int bytes_to_write;
   int i;
 
-  /* Need to remove each page from the process' list of virtual pages
-     (Supplemental page table). Also, each page that has been written to by the
-     process must be written back to the file. */
   for (i = 0; i < num_pages; i++) {
-    /* If dirty bit is set for this page, it has been written to. */
-    if (pagedir_is_dirty(pd, page_uaddr)) {
-
-      /* If we are on the last page, we don't want to write the last bytes on
-         this page (that 'stick out' beyond the end of file) back to the file.
-         This happens when file's length is not a multiple of PGSIZE, but even
-         in the case where the file size is a multiple of PGSIZE, both
-         outcomes of the below statement will set bytes_to_read to PGSIZE
-         (Because then end_uaddr - page_uaddr = PGSIZE). */
-      bytes_to_write = (i == (num_pages - 1)) ? (mmap->end_uaddr - page_uaddr)
-                                              : PGSIZE;
-
-      /* Must acquire lock when calling file system code. */
-      lock_acquire(&secure_file);
-      /* Ensure we write to correct position in file by using file_seek. */
-      file_seek(file, ((off_t) page_uaddr) - ((off_t) mmap->start_uaddr));
-      /* Write this page back to the file, as this page has been written to. */
-      file_write(file, page_uaddr, bytes_to_write);
-      lock_release(&secure_file);
-    }
+    struct spt_entry *entry = get_spt_entry(spt, page_uaddr);
+
+    /* Write back and unmap the page, and free its frame, all without the
+       frame being evicted in between, which would otherwise leave it in the
+       frame table after its entry is freed. A page that is not in memory
+       was written back when it was evicted. */
+    frame_release_page(entry);
 
     /* Remove from process' list of virtual pages. */
-    struct spt_entry *entry = get_spt_entry(spt, page_uaddr);
     hash_delete(spt, &entry->elem);
-    free(entry);
+    kmem_cache_free(&spt_entry_cache, entry);
 
     /* Advance to the next page. */
     page_uaddr += PGSIZE;
@@ -4,6 +4,8 @@
 #include <list.h>
 #include "filesys/file.h"
 #include "lib/kernel/hash.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Process identifier. */
 typedef int pid_t;
@@ -27,6 +29,11 @@ struct proc_file {
   struct list_elem file_elem;
 };
 
+extern struct kmem_cache proc_file_cache;
+
+/* Serialises file system accesses. */
+extern struct lock secure_file;
+
 void syscall_init (void);
 void sys_exit (int status);
 void munmap_exiting(struct hash_elem *, void *);
@@ -0,0 +1,506 @@
+#include "vm/evict.h"
+#include <debug.h>
+#include <string.h>
+#include "lib/kernel/hash.h"
+#include "lib/kernel/list.h"
+#include "lib/random.h"
+#include "threads/slab.h"
+#include "devices/timer.h"
+
+/* Eviction policies.
+
+   Random and CLOCK sweep the frame table itself. WSClock does too, and also
+   keeps each frame's last_use up to date. 2Q and ARC keep the frames in use
+   on resident queues, threaded through fte_elem, and remember recently
+   evicted pages on ghost queues, so that they can recognise a page that
+   comes back soon after eviction.
+
+   The hardware only tells us about references through the accessed bits,
+   so a reference to a resident page is noticed when a policy samples the
+   frame's accessed bits while looking for a victim, not when it happens. */
+
+/* Resident queues, for 2Q and ARC. The front of each is the end that is
+   evicted from first. */
+static struct list queues[2];
+static size_t queue_len[2];
+
+/* Ghost queues, for 2Q and ARC. A ghost remembers the identity of a page
+   that was evicted, but not its contents. Ghosts are also kept in a hash
+   table, to find a faulting page among them. */
+struct ghost {
+  pid_t owner; /* Process that owned the page. */
+  const void *upage; /* User address of the page. */
+  int queue; /* Ghost queue that holds it. */
+  struct list_elem elem; /* In ghosts[queue], oldest at the front. */
+  struct hash_elem hash_elem; /* In ghost_table. */
+};
+
+static struct list ghosts[2];
+static size_t ghost_len[2];
+static struct hash ghost_table;
+static struct kmem_cache ghost_cache;
+
+/* Returns true if FTE can be chosen for eviction. */
+static bool
+evictable(const struct fte *fte) {
+  return fte->in_use && !fte->pinned;
+}
+
+/* Random. */
+
+/* Chooses a random frame, skipping pinned frames. Eviction only happens
+   when nearly every frame is in use, so this takes O(1) time on average. */
+static struct fte *
+random_choose(pid_t owner UNUSED, const void *upage UNUSED) {
+  size_t cnt = frame_table_size();
+  size_t idx = random_ulong() % cnt;
+  size_t i;
+
+  /* Take the first evictable frame from there on, wrapping around. */
+  for (i = 0; i < cnt; i++) {
+    struct fte *fte = frame_table_entry((idx + i) % cnt);
+    if (evictable(fte)) {
+      return fte;
+    }
+  }
+  return NULL;
+}
+
+/* Nothing to do for policies that keep no state about the frames. */
+static void
+no_init(void) {
+}
+
+static void
+no_add(struct fte *fte UNUSED) {
+}
+
+static void
+no_remove(struct fte *fte UNUSED, bool evicted UNUSED) {
+}
+
+const struct evict_policy evict_random = {
+  "random", no_init, no_add, no_remove, random_choose
+};
+
+/* CLOCK. */
+
+/* Next frame the clock hand examines, for CLOCK and WSClock. Persists
+   across evictions. */
+static size_t clock_hand;
+
+/* Returns the frame under the clock hand and advances the hand. */
+static struct fte *
+clock_advance(void) {
+  struct fte *fte = frame_table_entry(clock_hand);
+  clock_hand = (clock_hand + 1) % frame_table_size();
+  return fte;
+}
+
+/* Chooses a frame with the CLOCK (second chance) algorithm. The clock hand
+   sweeps the frame table in order, from where it stopped last time. A frame
+   that has been accessed since the hand last passed it has its accessed bits
+   cleared and is passed over; the first one that has not is the victim. */
+static struct fte *
+clock_choose(pid_t owner UNUSED, const void *upage UNUSED) {
+  size_t i;
+
+  /* After one full turn every accessed bit has been cleared, so a second
+     turn must find a victim if there is any. */
+  for (i = 0; i < 2 * frame_table_size(); i++) {
+    struct fte *fte = clock_advance();
+    if (evictable(fte) && !frame_test_and_clear_accessed(fte)) {
+      return fte;
+    }
+  }
+  return NULL;
+}
+
+const struct evict_policy evict_clock = {
+  "clock", no_init, no_add, no_remove, clock_choose
+};
+
+/* WSClock. */
+
+/* A page that has not been used for more than WSCLOCK_TAU timer ticks is
+   outside its process's working set. */
+#define WSCLOCK_TAU 100
+
+/* Chooses a frame with the WSClock algorithm. The clock hand makes one turn
+   of the frame table, from where it stopped last time, refreshing the
+   last_use of each frame that has been accessed since the hand last passed
+   it. The first clean frame outside its working set is the victim. There is
+   no writer to clean dirty frames in the background, so if every frame
+   outside its working set is dirty, the first of those is the victim, and if
+   every frame is inside its working set, the least recently used is. */
+static struct fte *
+wsclock_choose(pid_t owner UNUSED, const void *upage UNUSED) {
+  int64_t now = timer_ticks();
+  struct fte *old_dirty = NULL;
+  struct fte *oldest = NULL;
+  size_t i;
+
+  for (i = 0; i < frame_table_size(); i++) {
+    struct fte *fte = clock_advance();
+    if (!evictable(fte)) {
+      continue;
+    }
+    if (frame_test_and_clear_accessed(fte)) {
+      fte->last_use = now;
+    } else if (now - fte->last_use > WSCLOCK_TAU) {
+      if (!frame_is_dirty(fte)) {
+        return fte;
+      }
+      if (old_dirty == NULL) {
+        old_dirty = fte;
+      }
+    }
+    if (oldest == NULL || fte->last_use < oldest->last_use) {
+      oldest = fte;
+    }
+  }
+  return old_dirty != NULL ? old_dirty : oldest;
+}
+
+const struct evict_policy evict_wsclock = {
+  "wsclock", no_init, no_add, no_remove, wsclock_choose
+};
+
+/* Resident and ghost queues. */
+
+static unsigned
+ghost_hash(const struct hash_elem *e, void *aux UNUSED) {
+  const struct ghost *g = hash_entry(e, struct ghost, hash_elem);
+  return hash_int(g->owner) ^ hash_bytes(&g->upage, sizeof g->upage);
+}
+
+static bool
+ghost_less(const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED) {
+  const struct ghost *a = hash_entry(a_, struct ghost, hash_elem);
+  const struct ghost *b = hash_entry(b_, struct ghost, hash_elem);
+  return a->owner != b->owner ? a->owner < b->owner : a->upage < b->upage;
+}
+
+/* Initialises the resident and ghost queues. */
+static void
+queues_init(void) {
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    list_init(&queues[i]);
+    queue_len[i] = 0;
+    list_init(&ghosts[i]);
+    ghost_len[i] = 0;
+  }
+  if (!hash_init(&ghost_table, ghost_hash, ghost_less, NULL)) {
+    PANIC("Couldn't allocate ghost table.");
+  }
+  kmem_cache_init(&ghost_cache, "ghost", sizeof(struct ghost), NULL);
+}
+
+/* Appends FTE, which has just been added, to the back of resident queue
+   Q. */
+static void
+queue_push(struct fte *fte, int q) {
+  fte->queue = q;
+  fte->sampled = false;
+  list_push_back(&queues[q], &fte->fte_elem);
+  queue_len[q]++;
+}
+
+/* Removes FTE from its resident queue. */
+static void
+queue_remove(struct fte *fte) {
+  list_remove(&fte->fte_elem);
+  queue_len[fte->queue]--;
+}
+
+/* Moves FTE to the back of resident queue Q. */
+static void
+queue_move(struct fte *fte, int q) {
+  list_remove(&fte->fte_elem);
+  queue_len[fte->queue]--;
+  fte->queue = q;
+  list_push_back(&queues[q], &fte->fte_elem);
+  queue_len[q]++;
+}
+
+/* Returns the frame at the front of resident queue Q, or NULL if Q is
+   empty. */
+static struct fte *
+queue_front(int q) {
+  if (list_empty(&queues[q])) {
+    return NULL;
+  }
+  return list_entry(list_front(&queues[q]), struct fte, fte_elem);
+}
+
+/* Returns the ghost of page UPAGE of OWNER, or NULL if there is none. */
+static struct ghost *
+ghost_find(pid_t owner, const void *upage) {
+  struct ghost key;
+  struct hash_elem *e;
+
+  key.owner = owner;
+  key.upage = upage;
+  e = hash_find(&ghost_table, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct ghost, hash_elem) : NULL;
+}
+
+/* Removes and frees ghost G. */
+static void
+ghost_remove(struct ghost *g) {
+  hash_delete(&ghost_table, &g->hash_elem);
+  list_remove(&g->elem);
+  ghost_len[g->queue]--;
+  kmem_cache_free(&ghost_cache, g);
+}
+
+/* Removes the oldest ghosts from ghost queue Q until it has at most MAX. */
+static void
+ghost_trim(int q, size_t max) {
+  while (ghost_len[q] > max) {
+    ghost_remove(list_entry(list_front(&ghosts[q]), struct ghost, elem));
+  }
+}
+
+/* Adds a ghost of FTE's page to the back of ghost queue Q, first removing
+   the oldest ghosts so that Q holds at most MAX. Does nothing if MAX is 0,
+   or if no memory is available for the ghost. */
+static void
+ghost_put(const struct fte *fte, int q, size_t max) {
+  struct ghost *g;
+
+  if (max == 0) {
+    return;
+  }
+  ghost_trim(q, max - 1);
+  g = kmem_cache_alloc(&ghost_cache);
+  if (g == NULL) {
+    return;
+  }
+  g->owner = fte->owner;
+  g->upage = fte->upage;
+  g->queue = q;
+  /* A resident page has no ghost, since its ghost is removed when it is
+     brought back in. */
+  struct hash_elem *old = hash_insert(&ghost_table, &g->hash_elem);
+  ASSERT(old == NULL);
+  list_push_back(&ghosts[q], &g->elem);
+  ghost_len[q]++;
+}
+
+/* Samples the frames at the front of resident queue Q, in order, and returns
+   the first that has not been accessed since it was last sampled. A frame
+   that has been accessed has its accessed bits cleared and is moved to the
+   back of resident queue HIT_Q, except that the first time a frame is
+   sampled after being added, its accessed bits were set by the access that
+   brought the page in, so it is only moved to the back of Q. A pinned frame
+   is moved to the back of Q. Returns NULL if every frame on Q is pinned, or
+   if they are all moved to another queue. */
+static struct fte *
+queue_sample(int q, int hit_q) {
+  size_t cnt = queue_len[q];
+
+  /* Examine each frame at most three times: once its accessed bits are
+     cleared, a frame that comes round again is a victim unless it is
+     pinned. */
+  for (cnt = 3 * cnt; cnt > 0 && queue_len[q] > 0; cnt--) {
+    struct fte *fte = queue_front(q);
+    if (fte->pinned) {
+      queue_move(fte, q);
+    } else if (frame_test_and_clear_accessed(fte)) {
+      queue_move(fte, fte->sampled ? hit_q : q);
+      fte->sampled = true;
+    } else {
+      return fte;
+    }
+  }
+  return NULL;
+}
+
+/* 2Q.
+
+   A page seen for the first time goes on A1in, a FIFO of up to 1/4 of the
+   frames. A page evicted from A1in is remembered on the ghost queue A1out,
+   of up to 1/2 as many pages as there are frames. A page that is faulted in
+   again while it is on A1out has been used more than once, so it goes on Am,
+   which is kept in approximate LRU order. A sequential scan therefore only
+   ever displaces pages from A1in, leaving the working set on Am alone.
+
+   References to a page on A1in are ignored, as in the original algorithm,
+   since they are usually close together and say little about its later use.
+   References to a page on Am move it to the back of Am. */
+
+#define Q_A1IN 0
+#define Q_AM 1
+#define Q_A1OUT 0
+
+static void
+twoq_add(struct fte *fte) {
+  struct ghost *g = ghost_find(fte->owner, fte->upage);
+
+  if (g != NULL) {
+    ghost_remove(g);
+    queue_push(fte, Q_AM);
+  } else {
+    queue_push(fte, Q_A1IN);
+  }
+}
+
+static void
+twoq_remove(struct fte *fte, bool evicted) {
+  queue_remove(fte);
+  if (evicted && fte->queue == Q_A1IN) {
+    ghost_put(fte, Q_A1OUT, frame_table_size() / 2);
+  }
+}
+
+/* Returns the first unpinned frame on A1in, moving pinned frames to its
+   back, or NULL if there is none. */
+static struct fte *
+twoq_a1in_victim(void) {
+  size_t cnt;
+
+  for (cnt = queue_len[Q_A1IN]; cnt > 0; cnt--) {
+    struct fte *fte = queue_front(Q_A1IN);
+    if (!fte->pinned) {
+      return fte;
+    }
+    queue_move(fte, Q_A1IN);
+  }
+  return NULL;
+}
+
+static struct fte *
+twoq_choose(pid_t owner UNUSED, const void *upage UNUSED) {
+  struct fte *fte = NULL;
+
+  if (queue_len[Q_A1IN] > frame_table_size() / 4 || queue_len[Q_AM] == 0) {
+    fte = twoq_a1in_victim();
+  }
+  if (fte == NULL) {
+    fte = queue_sample(Q_AM, Q_AM);
+  }
+  if (fte == NULL) {
+    fte = twoq_a1in_victim();
+  }
+  return fte;
+}
+
+const struct evict_policy evict_2q = {
+  "2q", queues_init, twoq_add, twoq_remove, twoq_choose
+};
+
+/* ARC.
+
+   Resident pages seen once recently are on T1 and those seen at least twice
+   are on T2. Pages recently evicted from T1 and T2 are remembered on the
+   ghost queues B1 and B2. A fault on a page in B1 means T1 should have been
+   larger, and one on a page in B2 that T2 should have been, so the target
+   size arc_p of T1 is moved towards whichever would have kept the page, and
+   the page goes on T2. Victims are taken from T1 while it is above its
+   target, and from T2 otherwise. T1 plus B1 is kept to at most one page per
+   frame, and all four queues together to at most two. */
+
+#define Q_T1 0
+#define Q_T2 1
+#define Q_B1 0
+#define Q_B2 1
+
+static size_t arc_p; /* Target size of T1. */
+
+static void
+arc_init(void) {
+  queues_init();
+  arc_p = 0;
+}
+
+static void
+arc_add(struct fte *fte) {
+  size_t c = frame_table_size();
+  struct ghost *g = ghost_find(fte->owner, fte->upage);
+  size_t delta;
+
+  if (g == NULL) {
+    queue_push(fte, Q_T1);
+    return;
+  }
+  if (g->queue == Q_B1) {
+    delta = ghost_len[Q_B1] >= ghost_len[Q_B2] ? 1
+            : ghost_len[Q_B2] / ghost_len[Q_B1];
+    arc_p = arc_p + delta < c ? arc_p + delta : c;
+  } else {
+    delta = ghost_len[Q_B2] >= ghost_len[Q_B1] ? 1
+            : ghost_len[Q_B1] / ghost_len[Q_B2];
+    arc_p = arc_p > delta ? arc_p - delta : 0;
+  }
+  ghost_remove(g);
+  queue_push(fte, Q_T2);
+}
+
+static void
+arc_remove(struct fte *fte, bool evicted) {
+  size_t c = frame_table_size();
+  size_t t;
+
+  queue_remove(fte);
+  if (!evicted) {
+    return;
+  }
+  t = queue_len[Q_T1] + queue_len[Q_T2];
+  if (fte->queue == Q_T1) {
+    ghost_put(fte, Q_B1, c > queue_len[Q_T1] ? c - queue_len[Q_T1] : 0);
+  } else {
+    ghost_put(fte, Q_B2, 2 * c > t + ghost_len[Q_B1]
+                         ? 2 * c - t - ghost_len[Q_B1] : 0);
+  }
+}
+
+static struct fte *
+arc_choose(pid_t owner, const void *upage) {
+  struct ghost *g = upage != NULL ? ghost_find(owner, upage) : NULL;
+  bool in_b2 = g != NULL && g->queue == Q_B2;
+  struct fte *fte = NULL;
+  int q;
+
+  if (queue_len[Q_T1] > 0
+      && (queue_len[Q_T1] > arc_p || (in_b2 && queue_len[Q_T1] == arc_p))) {
+    q = Q_T1;
+  } else {
+    q = Q_T2;
+  }
+  fte = queue_sample(q, Q_T2);
+  if (fte == NULL) {
+    /* Everything on Q was pinned or has been referenced again, and the
+       frames referenced have all moved to T2. */
+    fte = queue_sample(Q_T2, Q_T2);
+  }
+  if (fte == NULL) {
+    fte = queue_sample(Q_T1, Q_T2);
+  }
+  return fte;
+}
+
+const struct evict_policy evict_arc = {
+  "arc", arc_init, arc_add, arc_remove, arc_choose
+};
+
+/* All the policies, by name. */
+static const struct evict_policy *const policies[] = {
+  &evict_random, &evict_clock, &evict_wsclock, &evict_2q, &evict_arc
+};
+
+/* Returns the eviction policy named NAME, or NULL if there is none. */
+const struct evict_policy *
+evict_policy_lookup(const char *name) {
+  size_t i;
+
+  for (i = 0; i < sizeof policies / sizeof *policies; i++) {
+    if (!strcmp(policies[i]->name, name)) {
+      return policies[i];
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef VM_EVICT_H
+#define VM_EVICT_H
+
+#include <stdbool.h>
+#include "vm/frame.h"
+
+/* An eviction policy. frame.c tells the policy about every frame that gets
+   or loses a page, and asks it to choose a victim when a frame is needed.
+   All calls are made with the frame table lock held. */
+struct evict_policy {
+  const char *name; /* Name, for the "-evict" option. */
+
+  /* Called once by frame_table_init(), after the frame table exists. */
+  void (*init)(void);
+
+  /* FTE has just been given page UPAGE of OWNER. */
+  void (*add)(struct fte *fte);
+
+  /* FTE is about to lose its page, because it was chosen as a victim if
+     EVICTED is true, or because the page was freed otherwise. */
+  void (*remove)(struct fte *fte, bool evicted);
+
+  /* Returns an unpinned frame in use to evict, to make room for page UPAGE
+     of OWNER, or for no page in particular if UPAGE is null. Returns null
+     if every frame is pinned or free. */
+  struct fte *(*choose)(pid_t owner, const void *upage);
+};
+
+extern const struct evict_policy evict_random;
+extern const struct evict_policy evict_clock;
+extern const struct evict_policy evict_wsclock;
+extern const struct evict_policy evict_2q;
+extern const struct evict_policy evict_arc;
+
+const struct evict_policy *evict_policy_lookup(const char *name);
+
+#endif /* vm/evict.h */
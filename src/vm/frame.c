@@ -1,25 +1,129 @@
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 #include "vm/frame.h"
-#include "lib/random.h"
-#include "threads/malloc.h"
+#include "vm/evict.h"
 #include "threads/palloc.h"
 #include "swap.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/vmalloc.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "devices/timer.h"
 
-static struct list frame_table;
+/* kswapd keeps between LOW_WATERMARK and twice that many user frames free,
+   where LOW_WATERMARK is 1/LOW_WATERMARK_DIV of the user pool, but at least
+   MIN_LOW_WATERMARK. */
+#define LOW_WATERMARK_DIV 32
+#define MIN_LOW_WATERMARK 4
+
+/* Most frames kswapd evicts at once. Those of the pages that must go to
+   swap are written together, to consecutive slots, in one request. */
+#define SWAP_CLUSTER 8
+
+/* The frame table has one struct fte for every page in the user pool,
+   allocated once by frame_table_init(), so the fte for a frame is found by
+   indexing, without searching or allocating. */
+static struct fte *frames; /* Frame descriptors, by page in user pool. */
+static size_t frame_cnt; /* Number of elements in frames. */
+static uint8_t *user_base; /* First page in the user pool. */
 static struct lock frame_table_lock;
 
+/* Eviction does its I/O without frame_table_lock: the victims are chosen,
+   pinned and unmapped under the lock, which is then released while their
+   pages are written out, and taken again to finish. A thread that needs a
+   page being evicted, to fault it back in, unmap it or tear down its owner,
+   waits on eviction_done until the eviction finishes. */
+static struct condition eviction_done;
+
+/* Eviction policy, set with the "-evict" kernel command-line option. */
+static const struct evict_policy *evict_policy = &evict_clock;
+
+/* Background reclaim. When fewer than low_watermark user frames are free,
+   frame_alloc() wakes kswapd, which evicts frames until high_watermark are
+   free, so that page faults usually find a free frame without waiting for
+   eviction I/O. */
+static size_t low_watermark;
+static size_t high_watermark;
+static struct semaphore kswapd_sema; /* Upped to wake kswapd. */
+static uint8_t *cluster_buf; /* SWAP_CLUSTER pages, to gather pages to swap. */
+static bool kswapd_started; /* Set once kswapd is running. */
+static bool kswapd_awake; /* True from waking kswapd until it sleeps again. */
+
+/* Reclaim statistics. */
+static unsigned long long kswapd_wakeups;
+static unsigned long long kswapd_reclaims;
+static unsigned long long direct_reclaims;
+
+/* Eviction statistics. */
+static unsigned long long evict_discards; /* Clean pages dropped. */
+static unsigned long long evict_writebacks; /* Pages written to files. */
+static unsigned long long evict_swapouts; /* Pages written to swap. */
+
 static void add_frame(void *frame, void *upage);
 static void remove_frame(void *frame);
-static bool less_recent (const struct list_elem *a, const struct list_elem *b, void *aux UNUSED);
+static struct fte *frame_to_fte(void *frame);
+static struct fte *find_frame(void *frame);
+static size_t evict_frames(struct fte **victims, size_t max, void *upage);
+static struct spt_entry *frame_page(struct fte *);
+static void wait_for_eviction(struct spt_entry *);
+static struct spt_entry *unmap_frame(struct fte *, bool *dirty);
+static bool needs_swap(struct spt_entry *, bool dirty);
+static void save_to_file(struct spt_entry *, bool dirty);
+static void swap_page(struct spt_entry *, pid_t owner);
+static void drop_swap_cache(void);
+static void write_back(struct spt_entry *);
+static size_t reclaim_frames(size_t max);
+static void check_watermarks(void);
+static void kswapd(void *aux UNUSED);
 
 /* Initialise the actual frame table itself, along with any locks required in
-   accessing the frame table. */
+   accessing the frame table. Must be called after vmalloc_init(). */
 void
 frame_table_init(void) {
-  list_init(&frame_table);
+  size_t i;
+
   lock_init(&frame_table_lock);
+  cond_init(&eviction_done);
+
+  user_base = palloc_user_pool(&frame_cnt);
+  frames = vmalloc(frame_cnt * sizeof *frames);
+  if (frames == NULL) {
+    PANIC("Couldn't allocate frame table.");
+  }
+  for (i = 0; i < frame_cnt; i++) {
+    frames[i].frame = user_base + i * PGSIZE;
+    frames[i].pinned = false;
+    frames[i].evicting = false;
+    frames[i].in_use = false;
+  }
+  evict_policy->init();
+}
+
+/* Sets the watermarks from the size of the user pool and starts kswapd.
+   Must be called once the scheduler and swap are up. */
+void
+frame_reclaim_init(void) {
+  size_t user_frames = palloc_free_cnt(PAL_USER);
+
+  low_watermark = user_frames / LOW_WATERMARK_DIV;
+  if (low_watermark < MIN_LOW_WATERMARK) {
+    low_watermark = MIN_LOW_WATERMARK;
+  }
+  high_watermark = 2 * low_watermark;
+
+  cluster_buf = vmalloc(SWAP_CLUSTER * PGSIZE);
+  if (cluster_buf == NULL) {
+    PANIC("Couldn't allocate swap cluster buffer.");
+  }
+
+  sema_init(&kswapd_sema, 0);
+  if (thread_create("kswapd", PRI_DEFAULT, kswapd, NULL) == TID_ERROR) {
+    PANIC("Couldn't start kswapd.");
+  }
+  kswapd_started = true;
 }
 
 /* Called instead of palloc_get_page() when allocating a user page.
@@ -27,7 +131,9 @@ frame_table_init(void) {
    that page. Calls a function to handle eviction if the frame table is full.
    Returns the page returned from palloc_get_page(), or the return value of
    evict(). Panics if no frame can evicted without allocating a swap slot, and
-   swap slot is full. */
+   swap slot is full. The frame is returned pinned: once it has been filled
+   and installed, the caller must call frame_unpin() so that it can be
+   evicted. */
 void *
 frame_alloc(enum palloc_flags flags, void *upage) {
     /* frame_alloc() must only be called when allocating a user page. */
@@ -48,16 +154,34 @@ frame_alloc(enum palloc_flags flags, void *upage) {
       PANIC("No frame can be evicted without allocating a swap slot, and swap "
               "slot is full.\n");
     }
+    direct_reclaims++;
+    /* An evicted frame holds its old contents. */
+    if (flags & PAL_ZERO) {
+      memset(frame, 0, PGSIZE);
+    }
   } else {
     /* Otherwise, we can simply add the frame to the frame
        table (in an fte). */
     add_frame(frame, upage);
   }
+  check_watermarks();
 
   /* Return the kernel virtual address of the actual frame in the fte. */
   return frame;
 }
 
+/* Allows FRAME, returned by frame_alloc(), to be evicted. Does nothing if
+   FRAME has already been freed. */
+void
+frame_unpin(void *frame) {
+  lock_acquire(&frame_table_lock);
+  struct fte *fte = find_frame(frame);
+  if (fte != NULL) {
+    fte->pinned = false;
+  }
+  lock_release(&frame_table_lock);
+}
+
 /* Remove frame for this page from frame table, and then free the page
    itself. Called instead of palloc_free_page() (in process.c only??).
    Argument is return value of frame_alloc(). */
@@ -67,184 +191,553 @@ frame_free(void *frame) {
   palloc_free_page(frame);
 }
 
-/* Called if frame table is full. Chooses a RANDOM frame in
-   frame_table. */
-struct fte *
-choose_frame_to_evict_random(void) 
-{
-  int ftes = list_size(&frame_table);
-  ASSERT(ftes > 0);
-  /* Random number between 0 and (size - 1) inclusive. */
-  int random_fte = random_ulong() % ftes;
-  ASSERT(random_fte >= 0 && random_fte < ftes);
-  struct list_elem *e;
-  for (e = list_begin(&frame_table); random_fte > 0; random_fte--) {
-    e = list_next(e);
+/* Removes every frame owned by OWNER from the frame table, so that none of
+   them can be evicted while OWNER's page tables are torn down. The pages
+   themselves are freed by pagedir_destroy(). A frame already being evicted
+   is waited for, since the eviction still uses OWNER's page tables. */
+void
+frame_forget_owner(pid_t owner) {
+  size_t i;
+
+  lock_acquire(&frame_table_lock);
+  for (i = 0; i < frame_cnt; i++) {
+    struct fte *fte = &frames[i];
+    while (fte->in_use && fte->owner == owner && fte->evicting) {
+      cond_wait(&eviction_done, &frame_table_lock);
+    }
+    if (fte->in_use && fte->owner == owner) {
+      evict_policy->remove(fte, false);
+      fte->in_use = false;
+    }
+  }
+  lock_release(&frame_table_lock);
+}
+
+/* Selects the eviction policy named NAME (see evict_policy_lookup()).
+   Returns false if there is no such policy. Must be called before
+   frame_table_init(). */
+bool
+frame_set_evict_policy(const char *name) {
+  const struct evict_policy *policy = evict_policy_lookup(name);
+
+  ASSERT(frames == NULL);
+  if (policy == NULL) {
+    return false;
   }
-  struct fte *fte = list_entry(e, struct fte, fte_elem);
-  return fte;
+  evict_policy = policy;
+  return true;
+}
+
+/* Returns the number of frames in the frame table, in use or not. */
+size_t
+frame_table_size(void) {
+  return frame_cnt;
 }
 
+/* Returns the fte of the IDX'th frame in the user pool. */
 struct fte *
-choose_frame_to_evict_snd_chance(void) 
-{
+frame_table_entry(size_t idx) {
+  ASSERT(idx < frame_cnt);
+  return &frames[idx];
+}
 
-  ASSERT(!list_empty(&frame_table));
+/* Returns true if FTE's page has been accessed since the last call, through
+   either its user address in its owner's page directory or its kernel
+   address, and clears both accessed bits. frame_table_lock must be held. */
+bool
+frame_test_and_clear_accessed(struct fte *fte) {
+  ASSERT(lock_held_by_current_thread(&frame_table_lock));
+  struct thread *t = tid_to_thread((tid_t) fte->owner);
+  ASSERT(t != NULL);
+  bool accessed = false;
 
-  list_sort(&frame_table, less_recent, 0);
+  if (pagedir_is_accessed(t->pagedir, fte->upage)) {
+    pagedir_set_accessed(t->pagedir, fte->upage, false);
+    accessed = true;
+  }
+  if (pagedir_is_accessed(init_page_dir, fte->frame)) {
+    pagedir_set_accessed(init_page_dir, fte->frame, false);
+    /* The kernel mapping is shared by every page directory, so flush it
+       from the TLB whichever one is active. */
+    asm volatile ("invlpg (%0)" : : "r" (fte->frame) : "memory");
+    accessed = true;
+  }
+  return accessed;
+}
 
-  struct list_elem *e;
-  struct fte *fte_entry;
+/* Returns true if FTE's page has been written through its user address
+   since it was brought in. Writes through the kernel address are not
+   counted, since the kernel writes every page when filling it.
+   frame_table_lock must be held. */
+bool
+frame_is_dirty(struct fte *fte) {
+  ASSERT(lock_held_by_current_thread(&frame_table_lock));
+  struct thread *t = tid_to_thread((tid_t) fte->owner);
+  ASSERT(t != NULL);
+  return pagedir_is_dirty(t->pagedir, fte->upage);
+}
 
+/* Evict a frame. Returns a frame (the evicted frame), like frame_alloc() would have returned. Returns
+   NULL on failure. */
+void *
+evict(void *upage) {
+  struct fte *victim;
 
-  for (e = list_begin(&frame_table); ; e = list_next(e)) 
-  {
+  if (evict_frames(&victim, 1, upage) == 0) {
+    return NULL;
+  }
+  return victim->frame;
+}
 
-    if (e == list_end(&frame_table)) {
-      e = list_begin(&frame_table);
-    }
-      
-    fte_entry = list_entry(e, struct fte, fte_elem);
-    int tid = (tid_t) fte_entry->owner;
-    struct thread *t = tid_to_thread(tid);
+/* Evicts up to MAX frames, at most SWAP_CLUSTER, storing them in VICTIMS,
+   and returns the number evicted, which is 0 only if every frame is pinned.
+   If UPAGE is nonnull, MAX must be 1, and the frame is chosen for, and then
+   handed pinned to, the current process at UPAGE. Otherwise the victims are
+   removed from the frame table and the caller must free them.
+
+   Each page is saved wherever its owner will next find it. The victims are
+   pinned and unmapped under frame_table_lock, so the owner cannot change a
+   page while it is written out, but the lock is released for the I/O. An
+   owner that faults on its page meanwhile waits in frame_wait_evicted().
+   The pages of a cluster that must go to swap are gathered in cluster_buf
+   and written to consecutive slots with a single request, or one at a time
+   if there is no run of free slots long enough.
+
+   Only pages that the owner has written need to be saved. Whether it has is
+   told by the dirty bit of the page's user address: the kernel writes every
+   page through its kernel address when filling it, but writes to a page on
+   the owner's behalf, such as by read(), go through the user address. */
+static size_t
+evict_frames(struct fte **victims, size_t max, void *upage) {
+  struct spt_entry *entries[SWAP_CLUSTER];
+  bool dirty[SWAP_CLUSTER];
+  struct spt_entry *to_swap[SWAP_CLUSTER];
+  pid_t owners[SWAP_CLUSTER];
+  pid_t cur = (pid_t) thread_current()->tid;
+  bool need_file = false, file_locked = false;
+  size_t victim_cnt, swap_cnt, i;
+
+  ASSERT(max <= SWAP_CLUSTER);
+  ASSERT(upage == NULL || max == 1);
 
-    if (pagedir_is_accessed(t->pagedir, fte_entry->upage)) {
-      pagedir_set_accessed(t->pagedir, fte_entry->upage, false);
-    } else {
+  lock_acquire(&frame_table_lock);
+  for (victim_cnt = 0; victim_cnt < max; victim_cnt++) {
+    struct fte *fte = evict_policy->choose(upage != NULL ? cur : 0, upage);
+    if (fte == NULL) {
       break;
     }
+    evict_policy->remove(fte, true);
+    fte->pinned = true;
+    fte->evicting = true;
+    victims[victim_cnt] = fte;
+    if (frame_page(fte)->info == MMAP) {
+      need_file = true;
+    }
+  }
+  if (victim_cnt == 0) {
+    lock_release(&frame_table_lock);
+    return 0;
   }
 
-  return fte_entry;
+  /* A dirty MMAP page is written back under secure_file. A thread holding
+     that lock may fault and wait for frame_table_lock, so take it without
+     frame_table_lock, and before unmapping anything, so that no thread
+     holding it waits for these pages. */
+  if (need_file && !lock_held_by_current_thread(&secure_file)) {
+    lock_release(&frame_table_lock);
+    lock_acquire(&secure_file);
+    file_locked = true;
+    lock_acquire(&frame_table_lock);
+  }
+  for (i = 0; i < victim_cnt; i++) {
+    entries[i] = unmap_frame(victims[i], &dirty[i]);
+  }
+  lock_release(&frame_table_lock);
 
+  swap_cnt = 0;
+  for (i = 0; i < victim_cnt; i++) {
+    struct spt_entry *entry = entries[i];
+    if (!needs_swap(entry, dirty[i])) {
+      save_to_file(entry, dirty[i]);
+    } else if (victim_cnt == 1) {
+      swap_page(entry, victims[i]->owner);
+    } else {
+      /* A dirty page's old copy in swap is stale, so give up its slot and
+         write the page with the others. */
+      if (entry->swap_slot != NO_SWAP_SLOT) {
+        swap_free(entry->swap_slot);
+        entry->swap_slot = NO_SWAP_SLOT;
+      }
+      memcpy(cluster_buf + swap_cnt * PGSIZE, victims[i]->frame, PGSIZE);
+      owners[swap_cnt] = victims[i]->owner;
+      to_swap[swap_cnt++] = entry;
+    }
+  }
+  if (swap_cnt > 0) {
+    size_t slot = swap_in_cluster(cluster_buf, swap_cnt, owners);
+    for (i = 0; i < swap_cnt; i++) {
+      if (slot != NO_SWAP_SLOT) {
+        to_swap[i]->swap_slot = slot + i;
+        to_swap[i]->info = SWAP;
+        evict_swapouts++;
+      } else {
+        swap_page(to_swap[i], owners[i]);
+      }
+    }
+  }
+  if (file_locked) {
+    lock_release(&secure_file);
+  }
+
+  lock_acquire(&frame_table_lock);
+  for (i = 0; i < victim_cnt; i++) {
+    struct fte *fte = victims[i];
+    entries[i]->frame_addr = NULL;
+    fte->evicting = false;
+    if (upage != NULL) {
+      /* The frame now belongs to the current process, at UPAGE. */
+      fte->upage = upage;
+      fte->owner = cur;
+      fte->last_use = timer_ticks();
+      evict_policy->add(fte);
+    } else {
+      fte->in_use = false;
+    }
+  }
+  cond_broadcast(&eviction_done, &frame_table_lock);
+  lock_release(&frame_table_lock);
+  return victim_cnt;
 }
 
-static bool 
-less_recent (const struct list_elem *a,
-             const struct list_elem *b,
-             void *aux UNUSED)
+/* Returns the spt_entry of the page in FTE. frame_table_lock must be
+   held. */
+static struct spt_entry *
+frame_page(struct fte *fte)
 {
-  struct fte *fte_a = list_entry(a, struct fte, fte_elem);
-  struct fte *fte_b = list_entry(b, struct fte, fte_elem);
+  ASSERT(lock_held_by_current_thread(&frame_table_lock));
+  struct thread *t = tid_to_thread((tid_t) fte->owner);
+  ASSERT(t != NULL);
+  struct spt_entry *entry = get_spt_entry(&t->supp_pt, fte->upage);
+  ASSERT(entry != NULL);
+  return entry;
+}
 
-  return fte_a->clock_counter < fte_b->clock_counter;
+/* Waits until page ENTRY is not being evicted. frame_table_lock must be
+   held. */
+static void
+wait_for_eviction(struct spt_entry *entry)
+{
+  ASSERT(lock_held_by_current_thread(&frame_table_lock));
+  while (entry->frame_addr != NULL
+         && frame_to_fte(entry->frame_addr)->evicting) {
+    cond_wait(&eviction_done, &frame_table_lock);
+  }
 }
 
-/* Evict a frame. Returns a frame (the evicted frame), like frame_alloc() would have returned. Returns
-   NULL on failure. */
-void *
-evict(void *upage) {
+/* Called when the current process faults on page ENTRY. If the page is
+   being evicted, waits until it has been written out, so that it is read
+   back from where it went. */
+void
+frame_wait_evicted(struct spt_entry *entry)
+{
   lock_acquire(&frame_table_lock);
-  struct fte *frame_entry = choose_frame_to_evict_random();
-  void *frame_to_evict = frame_entry->frame;
-  save_frame(frame_entry, upage);
+  wait_for_eviction(entry);
   lock_release(&frame_table_lock);
-  return frame_to_evict;
 }
 
-
-void
-save_frame(struct fte *frame, void *upage)
+/* Unmaps FRAME from its owner's page directory, stores in *DIRTY whether
+   the owner has written to it, and returns its page's spt_entry. */
+static struct spt_entry *
+unmap_frame(struct fte *frame, bool *dirty)
 {
-  frame->owner = thread_current()->tid;
   struct thread *t = tid_to_thread((tid_t) frame->owner);
-  ASSERT(t != NULL);
-  struct spt_entry *entry = get_spt_entry(&t->supp_pt, frame->upage);
-  
-  bool dirty = pagedir_is_dirty(t->pagedir, entry->vaddr);
-  
-  /* If executable, store it in SWAP space.*/
-  if (entry->file_info.executable && entry->info == FSYS) {
-      entry->info = SWAP;
-  }
-  
-  if (entry->info == SWAP || entry->info == ALL_ZERO) {
-      size_t swap_slot = swap_in(entry->frame_addr);
-      entry->swap_slot = swap_slot;
-      entry->info = SWAP;
-  } else if (entry->info == FSYS || entry->info == MMAP) {
-      file_write_at(entry->file_info.f, entry->frame_addr, entry->file_info.size, entry->file_info.offset);
+  struct spt_entry *entry = frame_page(frame);
+  *dirty = pagedir_is_dirty(t->pagedir, frame->upage);
+
+  pagedir_clear_page(t->pagedir, frame->upage);
+  entry->in_memory = false;
+  return entry;
+}
+
+/* Returns true if page ENTRY, being evicted, must be written to swap. */
+static bool
+needs_swap(struct spt_entry *entry, bool dirty)
+{
+  switch (entry->info) {
+    case FSYS:
+      /* A page of the executable, which is never written to. A clean page is
+         read from it again, so only a dirty one must go to swap. */
+    case ALL_ZERO:
+      /* Likewise, a clean all-zero page is zeroed again. */
+      return dirty;
+    case MMAP:
+      return false;
+    case SWAP:
+      /* A clean page still has the copy in the swap slot it was read from. */
+      return dirty || entry->swap_slot == NO_SWAP_SLOT;
   }
+  NOT_REACHED();
+}
+
+/* Saves page ENTRY, being evicted, which does not need to go to swap: writes
+   it back to its file if it is a DIRTY MMAP page, or else drops it. */
+static void
+save_to_file(struct spt_entry *entry, bool dirty)
+{
+  if (entry->info == MMAP && dirty) {
+    write_back(entry);
+  } else {
+    evict_discards++;
+  }
+}
+
+/* Writes page ENTRY of OWNER, which is being evicted, to swap. A page that
+   still has the slot it was read from is written back to that slot, since
+   the old copy there is stale. Otherwise, if swap is full, the slots of
+   clean pages in memory are given up to make room. */
+static void
+swap_page(struct spt_entry *entry, pid_t owner) {
+  if (entry->swap_slot != NO_SWAP_SLOT) {
+    swap_rewrite(entry->frame_addr, entry->swap_slot);
+  } else {
+    entry->swap_slot = swap_in(entry->frame_addr, owner);
+    if (entry->swap_slot == NO_SWAP_SLOT) {
+      lock_acquire(&frame_table_lock);
+      drop_swap_cache();
+      lock_release(&frame_table_lock);
+      entry->swap_slot = swap_in(entry->frame_addr, owner);
+      if (entry->swap_slot == NO_SWAP_SLOT) {
+        PANIC("No swap space available.");
+      }
+    }
+  }
+  entry->info = SWAP;
+  evict_swapouts++;
+}
+
+/* Frees the swap slots held by pages in memory, which only serve to avoid
+   writing those pages out again if they are evicted while clean.
+   frame_table_lock must be held. */
+static void
+drop_swap_cache(void) {
+  size_t i;
+
+  ASSERT(lock_held_by_current_thread(&frame_table_lock));
+  for (i = 0; i < frame_cnt; i++) {
+    struct fte *fte = &frames[i];
+    if (!fte->in_use) {
+      continue;
+    }
+    struct thread *t = tid_to_thread((tid_t) fte->owner);
+    ASSERT(t != NULL);
+    struct spt_entry *entry = get_spt_entry(&t->supp_pt, fte->upage);
+    if (entry != NULL && entry->in_memory
+        && entry->swap_slot != NO_SWAP_SLOT) {
+      swap_free(entry->swap_slot);
+      entry->swap_slot = NO_SWAP_SLOT;
+    }
+  }
+}
+
+/* Writes MMAP page ENTRY, which is in memory, back to its file. */
+static void
+write_back(struct spt_entry *entry) {
+  ASSERT(entry->info == MMAP);
+  file_write_at(entry->file_info.f, entry->frame_addr, entry->file_info.size,
+                entry->file_info.offset);
+  evict_writebacks++;
+}
+
+/* Frees the frame holding page ENTRY of the current process, if the page is
+   in memory, first writing the page back to its file if it is a dirty MMAP
+   page, and unmaps it. The frame is taken out of the frame table under
+   frame_table_lock, so it cannot be evicted meanwhile, and the write is done
+   after releasing the lock, under secure_file. Called when the page is being
+   removed from the supplemental page table. */
+void
+frame_release_page(struct spt_entry *entry) {
+  struct thread *cur = thread_current();
+  bool dirty;
+
+  lock_acquire(&frame_table_lock);
+  wait_for_eviction(entry);
+  struct fte *fte = entry->in_memory ? find_frame(entry->frame_addr) : NULL;
+  if (fte == NULL || fte->owner != (pid_t) cur->tid
+      || fte->upage != entry->vaddr) {
+    lock_release(&frame_table_lock);
+    return;
+  }
+  dirty = entry->info == MMAP && pagedir_is_dirty(cur->pagedir, entry->vaddr);
+  pagedir_clear_page(cur->pagedir, entry->vaddr);
   entry->in_memory = false;
-  pagedir_clear_page(t->pagedir, frame->upage);
+  evict_policy->remove(fte, false);
+  fte->pinned = true;
+  fte->in_use = false;
+  lock_release(&frame_table_lock);
+
+  if (dirty) {
+    bool file_locked = !lock_held_by_current_thread(&secure_file);
+    if (file_locked) {
+      lock_acquire(&secure_file);
+    }
+    write_back(entry);
+    if (file_locked) {
+      lock_release(&secure_file);
+    }
+  }
   entry->frame_addr = NULL;
-  frame->upage = upage;
+  palloc_free_page(fte->frame);
+}
+
+/* Evicts up to MAX frames, at most SWAP_CLUSTER, and returns them to the
+   user pool. Returns the number of frames freed, which is 0 only if every
+   frame is pinned. Called by kswapd. */
+static size_t
+reclaim_frames(size_t max) {
+  struct fte *victims[SWAP_CLUSTER];
+  size_t victim_cnt, i;
+
+  victim_cnt = evict_frames(victims, max, NULL);
+  for (i = 0; i < victim_cnt; i++) {
+    palloc_free_page(victims[i]->frame);
+  }
+  return victim_cnt;
+}
+
+/* Wakes kswapd if free user frames have fallen below the low watermark. */
+static void
+check_watermarks(void) {
+  if (!kswapd_started || palloc_free_cnt(PAL_USER) >= low_watermark) {
+    return;
+  }
+  enum intr_level old_level = intr_disable();
+  if (!kswapd_awake) {
+    kswapd_awake = true;
+    sema_up(&kswapd_sema);
+  }
+  intr_set_level(old_level);
+}
+
+/* Background reclaim thread. Each time it is woken, evicts frames until
+   high_watermark frames are free or no frame can be evicted. */
+static void
+kswapd(void *aux UNUSED) {
+  for (;;) {
+    sema_down(&kswapd_sema);
+    kswapd_wakeups++;
+    for (;;) {
+      size_t free_cnt = palloc_free_cnt(PAL_USER);
+      size_t cnt = 0;
+      if (free_cnt < high_watermark) {
+        cnt = high_watermark - free_cnt;
+        cnt = reclaim_frames(cnt < SWAP_CLUSTER ? cnt : SWAP_CLUSTER);
+        kswapd_reclaims += cnt;
+        if (cnt > 0) {
+          continue;
+        }
+      }
+
+      /* Sleep if nothing could be evicted, or if enough frames are free.
+         Recheck the latter and clear kswapd_awake with interrupts off, as
+         check_watermarks() reads it, so that the wakeup of a thread that
+         took frames below the low watermark since the check above is not
+         lost. */
+      enum intr_level old_level = intr_disable();
+      bool sleep = free_cnt < high_watermark
+                   || palloc_free_cnt(PAL_USER) >= low_watermark;
+      if (sleep) {
+        kswapd_awake = false;
+      }
+      intr_set_level(old_level);
+      if (sleep) {
+        break;
+      }
+    }
+  }
+}
+
+/* Stores the watermarks and reclaim counters in *STATS. */
+void
+frame_get_stats(struct frame_stats *stats) {
+  stats->free_frames = palloc_free_cnt(PAL_USER);
+  stats->low_watermark = low_watermark;
+  stats->high_watermark = high_watermark;
+  stats->kswapd_wakeups = kswapd_wakeups;
+  stats->kswapd_reclaims = kswapd_reclaims;
+  stats->direct_reclaims = direct_reclaims;
+  stats->evict_policy = evict_policy->name;
+  stats->evict_discards = evict_discards;
+  stats->evict_writebacks = evict_writebacks;
+  stats->evict_swapouts = evict_swapouts;
+}
+
+/* Prints the reclaim statistics. */
+void
+frame_print_stats(void) {
+  struct frame_stats stats;
+
+  frame_get_stats(&stats);
+  printf("Frames: %zu free, watermarks %zu/%zu; kswapd woken %llu times, "
+         "reclaimed %llu; %llu direct reclaims (%s eviction)\n",
+         stats.free_frames, stats.low_watermark, stats.high_watermark,
+         stats.kswapd_wakeups, stats.kswapd_reclaims, stats.direct_reclaims,
+         stats.evict_policy);
+  printf("Evictions: %llu clean pages dropped, %llu written back, "
+         "%llu swapped out\n",
+         stats.evict_discards, stats.evict_writebacks, stats.evict_swapouts);
 }
 
 
 /* Creates a frame that will contain a pointer to the given page, and adds
    this frame to the frame table. Returns true if frame was successfully
    added, or false otherwise (i.e. if there was not enough memory to
-   malloc space for a struct frame). Called in frame_alloc(). */
+   allocate a struct fte). Called in frame_alloc(). */
 static void
 add_frame(void *frame, void *upage) {
-  /* Frame is freed in remove_frame(). */
-  struct fte *fte = malloc(sizeof(struct fte));
-  /* Panic if struct fte could not be successfully malloc'd. */
-  if (fte == NULL) {
-    PANIC("System can not allocate more frames.");
-  }
-
+  struct fte *fte = frame_to_fte(frame);
   struct thread *cur = thread_current();
 
   /* Set members of struct fte. */
-  fte->frame = frame;
   fte->upage = upage;
   fte->owner = (pid_t) cur->tid;
-  fte->clock_counter = timer_ticks();
+  fte->last_use = timer_ticks();
+  fte->pinned = true;
 
-  /* Add the created frame to the frame table. Must acquire a lock while
-     accessing this list, because other threads could try to access this list
-     at the same time. */
+  /* Add the created frame to the frame table. Must acquire a lock, because
+     other threads could be evicting at the same time. */
   lock_acquire(&frame_table_lock);
-  list_push_back(&frame_table, &fte->fte_elem);
+  ASSERT(!fte->in_use);
+  fte->in_use = true;
+  evict_policy->add(fte);
   lock_release(&frame_table_lock);
 }
 
+/* Returns the fte for FRAME, which must be a page in the user pool. */
+static struct fte *
+frame_to_fte(void *frame) {
+  size_t idx = ((uint8_t *) frame - user_base) / PGSIZE;
+  ASSERT(pg_ofs(frame) == 0);
+  ASSERT(idx < frame_cnt);
+  return &frames[idx];
+}
+
+/* Returns the fte for FRAME, or NULL if it is not in the frame table.
+   frame_table_lock must be held. */
+static struct fte *
+find_frame(void *frame) {
+  struct fte *fte = frame_to_fte(frame);
+  return fte->in_use ? fte : NULL;
+}
+
 /* Removes the frame from the frame table that has the pointer to the
    supplied page in it. Called in frame_free(). */
 static void
 remove_frame(void *frame) {
-  struct list_elem *e;
-  struct fte *fte;
-
-  /* Traverse frame table until we find a frame with a pointer to the
-     supplied page. */
   lock_acquire(&frame_table_lock);
-  for(e = list_begin(&frame_table);
-      e != list_end(&frame_table);
-      e = list_next(e)) {
-
-    fte = list_entry(e, struct fte, fte_elem);
-
-    if (fte->frame == frame) {
-      list_remove(e);
-      /* Ensure we free the fte, as we malloc'd space for this in
-         add_frame(). */
-      free(fte);
-      break;
-    }
-
+  struct fte *fte = find_frame(frame);
+  if (fte != NULL) {
+    evict_policy->remove(fte, false);
+    fte->in_use = false;
   }
   lock_release(&frame_table_lock);
 }
-
-void 
-update_frame_clock_counters(void) 
-{
-  // Skeleton for second chance algorithm
-  // Commented as we have a problem to access frame's "owner" thread.
-
-  // struct list_elem *e;
-  // for (e = list_begin(&frame_table); e != list_end(&frame_table) ; e = list_next(e)) 
-  // {
-  //   struct fte *fte_entry = list_entry(e, struct fte, fte_elem);
-  //   int tid = (tid_t) fte_entry->owner;
-  //   struct thread *t = tid_to_thread(tid);
-
-  //   if (pagedir_is_accessed(t->pagedir, fte_entry->upage)) {
-  //     pagedir_set_accessed(t->pagedir, fte_entry->upage, false);
-  //     fte_entry->clock_counter = timer_ticks();
-  //   }
-  // }
-}
@@ -13,20 +13,51 @@ struct fte {
   void *frame; /* The frame itself, as the frame is 'just a page'. */
   void *upage; /* Pointer to page that currently occupies this frame. */
   pid_t owner; /* pid of process that owns this frame. */
-  struct list_elem fte_elem; /* To allow each frame to be added to 'static
-                                  struct list frames' in 'frame.c'. */
-  uint64_t clock_counter; /* Allows us to order the frame table for the second
-                             chance eviction algorithm. */
+  struct list_elem fte_elem; /* In the eviction policy's queue, if it keeps
+                                one (see vm/evict.c). */
+  int queue; /* Which of the eviction policy's queues holds the frame. */
+  bool sampled; /* True once the eviction policy has sampled the frame's
+                   accessed bits since the frame was filled. */
+  int64_t last_use; /* Timer tick when the frame was filled, or when the
+                       eviction policy last saw it accessed. */
+  bool pinned; /* True while the frame is being filled or evicted, so that
+                  it must not be chosen for eviction. Cleared by
+                  frame_unpin(). */
+  bool evicting; /* True while the frame's page is being written out, with
+                    frame_table_lock released. */
+  bool in_use; /* True if the frame holds a user page, false if it is free
+                  in the user pool. */
+};
+
+/* Reclaim statistics, as returned by frame_get_stats(). */
+struct frame_stats {
+  size_t free_frames; /* Frames now free in the user pool. */
+  size_t low_watermark; /* kswapd is woken when fewer frames are free. */
+  size_t high_watermark; /* kswapd reclaims until this many are free. */
+  unsigned long long kswapd_wakeups; /* Times kswapd was woken. */
+  unsigned long long kswapd_reclaims; /* Frames freed by kswapd. */
+  unsigned long long direct_reclaims; /* Frames evicted by frame_alloc(). */
+  const char *evict_policy; /* Name of the eviction policy. */
+  unsigned long long evict_discards; /* Clean pages dropped on eviction. */
+  unsigned long long evict_writebacks; /* Pages written back to files. */
+  unsigned long long evict_swapouts; /* Pages written to swap. */
 };
 
 void frame_table_init(void);
+void frame_reclaim_init(void);
 void *frame_alloc(enum palloc_flags flags, void *upage);
+void frame_unpin(void *frame);
 void frame_free(void *frame);
-struct fte *choose_frame_to_evict_random(void);
-struct fte *choose_frame_to_evict_snd_chance(void);
-void save_frame(struct fte *, void*);
+void frame_forget_owner(pid_t owner);
+void frame_release_page(struct spt_entry *entry);
+void frame_wait_evicted(struct spt_entry *entry);
+bool frame_set_evict_policy(const char *name);
+size_t frame_table_size(void);
+struct fte *frame_table_entry(size_t idx);
+bool frame_test_and_clear_accessed(struct fte *);
+bool frame_is_dirty(struct fte *);
 void *evict(void *upage);
-void update_frame_clock_counters(void);
+void frame_get_stats(struct frame_stats *);
+void frame_print_stats(void);
 
 #endif /* vm/frame.h */
-
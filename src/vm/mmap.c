@@ -2,17 +2,27 @@
 #include <stddef.h>
 #include "vm/mmap.h"
 #include "threads/synch.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 
-/* Malloc's space for a struct mmap_mapping and sets all of its members,
+/* Cache of struct mmap_mappings. */
+static struct kmem_cache mmap_cache;
+
+/* Initialises the memory mapping module. */
+void
+mmap_init(void) {
+  kmem_cache_init(&mmap_cache, "mmap_mapping", sizeof(struct mmap_mapping),
+                  NULL);
+}
+
+/* Allocates a struct mmap_mapping and sets all of its members,
    before inserting it into mmap_table. Returns false if not enough
-   space to malloc. mmap_table_lock acquired before calling and
+   memory. mmap_table_lock acquired before calling and
    released after. */
 bool
 mmap_table_insert(struct hash *mmap_table, void *start_uaddr, void *end_uaddr,
     int num_pages, mapid_t mapid, struct file *file) {
   /* Freed in mmap_mapping_delete(). */
-  struct mmap_mapping *mmap = malloc(sizeof(struct mmap_mapping));
+  struct mmap_mapping *mmap = kmem_cache_alloc(&mmap_cache);
   if (mmap == NULL) {
     return false;
   }
@@ -45,9 +55,8 @@ mmap_mapping_lookup(struct hash *mmap_table, const mapid_t mapid) {
 void
 mmap_mapping_delete(struct hash *mmap_table, struct mmap_mapping *mmap) {
   hash_delete(mmap_table, &mmap->hash_elem);
-  /* Free the struct mmap_mapping allocated using malloc in
-     mmap_table_insert(). */
-  free(mmap);
+  /* Free the struct mmap_mapping allocated in mmap_table_insert(). */
+  kmem_cache_free(&mmap_cache, mmap);
 }
 
 unsigned
@@ -21,6 +21,7 @@ struct mmap_mapping {
                         file_reopen() is used. */
 };
 
+void mmap_init(void);
 bool mmap_table_insert(struct hash *mmap_table, void *start_uaddr,
     void *end_uaddr, int num_pages, mapid_t mapid, struct file* file);
 struct mmap_mapping *mmap_mapping_lookup(struct hash *mmap_table,
@@ -4,23 +4,33 @@
 #include "vm/frame.h"
 #include "vm/swap.h"
 #include "userprog/pagedir.h"
-#include "threads/malloc.h"
 #include "threads/interrupt.h"
 #include <string.h>
 
 
 static struct lock spt_lock;
 
+/* Cache of struct spt_entrys, for every process' supplemental page table. */
+struct kmem_cache spt_entry_cache;
+
 static unsigned generate_hash(const struct hash_elem *e, void *aux UNUSED);
 static bool compare_less_hash(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED);
 static void hash_free_elem(struct hash_elem *e, void *aux UNUSED);
 
-/* Initialises the supplemental page table and the spt_lock */
+/* Initialises the spt_entry cache and the spt_lock. */
+void
+page_init (void)
+{
+  kmem_cache_init(&spt_entry_cache, "spt_entry", sizeof(struct spt_entry),
+                  NULL);
+  lock_init(&spt_lock);
+}
+
+/* Initialises the supplemental page table. */
 void
 spt_init (struct hash *spt)
 {
   hash_init(spt, generate_hash, compare_less_hash, 0);
-  lock_init(&spt_lock);
 }
 
 /* Function which generates a hashkey, given a hash_elem */
@@ -48,13 +58,14 @@ spt_insert_all_zero(void *uaddr)
 {
   struct thread *cur = thread_current();
   struct hash_elem *elem;
-  struct spt_entry *entry = malloc(sizeof(struct spt_entry));
-  lock_acquire(&spt_lock);
+  struct spt_entry *entry = kmem_cache_alloc(&spt_entry_cache);
   if (entry == NULL) {
     return false;
   }
+  lock_acquire(&spt_lock);
   entry->info = ALL_ZERO;
   entry->vaddr = uaddr;
+  entry->swap_slot = NO_SWAP_SLOT;
   entry->in_memory = false;
   entry->file_info.writable = true;
   elem = hash_insert(&cur->supp_pt, &entry->elem);
@@ -75,7 +86,7 @@ spt_insert_file(void *uaddr, struct file *f, size_t size, size_t zeros, size_t o
 
   struct thread *cur = thread_current();
   struct hash_elem *elem;
-  struct spt_entry *entry = malloc(sizeof(struct spt_entry));
+  struct spt_entry *entry = kmem_cache_alloc(&spt_entry_cache);
   lock_acquire(&spt_lock);
   if (entry == NULL) {
     lock_release(&spt_lock);
@@ -88,6 +99,7 @@ spt_insert_file(void *uaddr, struct file *f, size_t size, size_t zeros, size_t o
   entry->file_info.writable = writable;
   entry->file_info.executable = executable;
   entry->vaddr = uaddr;
+  entry->swap_slot = NO_SWAP_SLOT;
   entry->in_memory = false;
 
   if (mmap) {
@@ -122,7 +134,10 @@ void
 load_from_disk(void *page, struct spt_entry *spt_entry)
 {
     
-  	swap_out(page, spt_entry->swap_slot);
+    if (!swap_out(page, spt_entry->swap_slot)) {
+      /* The slot was given up, so the page must be written out again. */
+      spt_entry->swap_slot = NO_SWAP_SLOT;
+    }
     bool success = install_page(spt_entry->vaddr, page, spt_entry->file_info.writable);
     if (!success) {
         frame_free(page);
@@ -163,15 +178,15 @@ void load_into_page (void *page, struct spt_entry *spt_entry)
   /* If page data is in memory mapped files, load into frame */
   } else if (spt_entry->info == MMAP) {
     load_file(page, spt_entry);
-  /* If page should be all-zero, fill it with zeroes */
+  /* If page should be all-zero, it was allocated with PAL_ZERO */
   } else if (spt_entry->info == ALL_ZERO){
-  	memset(page, 0, PGSIZE);
     install_page(spt_entry->vaddr, page, true);
   }
   spt_entry->in_memory = true;
 }
 
-/* Frees each spt_entry of the hashmap and destroys it. */
+/* Frees each spt_entry of the hashmap, and any swap slot it holds, and
+   destroys it. */
 void 
 spt_destroy (struct hash *hashmap)
 {
@@ -180,12 +195,15 @@ spt_destroy (struct hash *hashmap)
   lock_release(&spt_lock);
 }
 
-/* Frees an spt_entry, used in spt_destroy. */
+/* Frees an spt_entry and its swap slot, used in spt_destroy. */
 static void 
 hash_free_elem (struct hash_elem *e, void *aux UNUSED)
 {
   struct spt_entry *entry = hash_entry(e, struct spt_entry, elem);
-  free(entry);
+  if (entry->swap_slot != NO_SWAP_SLOT) {
+    swap_free(entry->swap_slot);
+  }
+  kmem_cache_free(&spt_entry_cache, entry);
 }
 
 /* The heuristic to check if stack should grow. */
@@ -201,9 +219,10 @@ should_stack_grow(void *addr, void *esp)
     return heuristic;
 }
 
-void
+/* Adds an all-zero page at ADDR to the stack, to be loaded like any other
+   page. Returns false if out of memory. */
+bool
 grow_stack(void *addr)
 {
-    void *page = frame_alloc(PAL_USER, addr);
-    pagedir_set_page(thread_current()->pagedir, pg_round_down(addr), page, true);
+    return spt_insert_all_zero(pg_round_down(addr));
 }
@@ -2,6 +2,7 @@
 #define VM_PAGE_H
 
 #include "lib/kernel/hash.h"
+#include "threads/slab.h"
 #include <stdio.h>
 
 #define MEGABYTE (1 << 20)
@@ -28,13 +29,24 @@ struct file_info {
 struct spt_entry {
 	void   *vaddr;
   void   *frame_addr;
-  size_t swap_slot;
+  size_t swap_slot; /* Swap slot holding a copy of the page, or
+                       NO_SWAP_SLOT. A SWAP page keeps its slot while it
+                       is in memory, clean or dirty: evicting it again
+                       drops a clean page and rewrites a dirty one in
+                       place with swap_rewrite(). The slot is freed only
+                       when the process exits, by drop_swap_cache() when
+                       swap is full, when a dirty page is written out
+                       with a cluster of others, or when the page is
+                       read back from zswap. */
   enum page_info info;
   struct file_info file_info;
   struct hash_elem elem;
   bool in_memory;
 };
 
+extern struct kmem_cache spt_entry_cache;
+
+void page_init(void);
 void spt_init(struct hash *spt);
 bool spt_insert_file(void *uaddr, struct file *f, size_t size, size_t zeros,
                      size_t offset, bool writable, bool mmap, bool executable);
@@ -48,6 +60,6 @@ void load_file(void *page, struct spt_entry *entry);
 bool install_page(void *upage, void *kpage, bool writable);
 
 bool should_stack_grow(void *uaddr, void *esp);
-void grow_stack(void *addr);
+bool grow_stack(void *addr);
 
 #endif /* vm/page.h */
@@ -1,14 +1,73 @@
 #include "vm/swap.h"
+#include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vmalloc.h"
 #include "lib/kernel/bitmap.h"
 #include "userprog/pagedir.h"
+#include "vm/zswap.h"
+
+/* Each page written to a swap slot is offered to zswap first, and is only
+   written to the swap device if zswap does not take it. When zswap runs out
+   of room, it hands back its oldest pages, which are written to their slots
+   on the device. A slot's page is therefore in zswap or on the device, never
+   both, and a page read back from zswap leaves it, so that it is not also
+   kept in memory compressed. All of this happens with swap_lock held, so
+   that a page on its way to the device cannot be read back before it gets
+   there. */
+
+/* Swap readahead. A fault on swap slot S asks the swapra thread to read
+   the next SWAP_RA_WINDOW slots, where they hold pages of the same process,
+   into the readahead cache, so that a process going through its pages in
+   the order they were swapped out finds the next ones already in memory.
+   A cached copy is dropped once it is used, and whenever its slot is freed
+   or rewritten. */
+#define SWAP_RA_WINDOW 8                /* Slots read after a fault. */
+#define SWAP_RA_CACHE 16                /* Pages in the readahead cache. */
+
+/* States of a page in the readahead cache. */
+enum ra_state {
+    RA_FREE,                            /* Unused. */
+    RA_LOADING,                         /* Being read from its slot. */
+    RA_VALID                            /* Holds a copy of its slot. */
+};
+
+/* A page in the readahead cache. */
+struct ra_page {
+    size_t slot;                        /* Slot cached. */
+    enum ra_state state;
+};
 
 struct block *swap_space;
 struct lock swap_lock;
 static struct bitmap *swap_bitmap;
 static int pages_in_swap_space;
+static pid_t *swap_owners;              /* Owner of each slot in use. */
+
+/* Readahead cache. Protected by swap_lock. */
+static struct ra_page ra_pages[SWAP_RA_CACHE];
+static uint8_t *ra_buf;                 /* Page I of ra_pages is at
+                                           ra_buf + I * PGSIZE. */
+static size_t ra_hand;                  /* Next page to reuse. */
+static size_t ra_request;               /* Slot to read ahead from, or
+                                           NO_SWAP_SLOT. */
+static struct semaphore ra_sema;        /* Upped when ra_request is set. */
+static uint8_t *wb_buf;                 /* Page written back from zswap. */
 
+/* Statistics. */
+static unsigned long long swap_writes;  /* Write requests. */
+static unsigned long long swap_pages_written;
+static unsigned long long swap_reads;   /* Pages read by faults. */
+static unsigned long long ra_reads;     /* Pages read ahead. */
+static unsigned long long ra_hits;      /* Faults served from the cache. */
+
+static void write_slots(const void *, size_t slot, size_t cnt);
+static bool zswap_put(const void *, size_t slot);
+static struct ra_page *ra_lookup(size_t slot);
+static void ra_invalidate(size_t slot);
+static void swapra(void *aux UNUSED);
 
 void
 swap_init(void)
@@ -18,48 +77,261 @@ swap_init(void)
       PANIC("Couldn't initialize swap space.");
     }
     pages_in_swap_space = block_size(swap_space) / SECTORS_PER_PAGE;
-    swap_bitmap = bitmap_create(pages_in_swap_space);
+    size_t buf_size = bitmap_buf_size(pages_in_swap_space);
+    void *buf = vmalloc(buf_size);
+    swap_owners = vmalloc(pages_in_swap_space * sizeof *swap_owners);
+    ra_buf = vmalloc(SWAP_RA_CACHE * PGSIZE);
+    wb_buf = vmalloc(PGSIZE);
+    if (buf == NULL || swap_owners == NULL || ra_buf == NULL
+        || wb_buf == NULL) {
+      PANIC("Couldn't allocate swap bitmap.");
+    }
+    swap_bitmap = bitmap_create_in_buf(pages_in_swap_space, buf, buf_size);
     lock_init(&swap_lock);
+    zswap_init(pages_in_swap_space);
+
+    ra_request = NO_SWAP_SLOT;
+    sema_init(&ra_sema, 0);
+    if (thread_create("swapra", PRI_DEFAULT, swapra, NULL) == TID_ERROR) {
+      PANIC("Couldn't start swap readahead.");
+    }
 }
 
+/* Writes page BUF, which belongs to OWNER, to a free swap slot, and returns
+   the slot, which stays in use until freed with swap_free(). Returns
+   NO_SWAP_SLOT if every slot is in use. */
 size_t
-swap_in(void *buf)
+swap_in(void *buf, pid_t owner)
 {
-    /* Find a free slot and set it to occupied.*/
+    return swap_in_cluster(buf, 1, &owner);
+}
+
+/* Writes the CNT pages at BUF, where page I belongs to OWNERS[I], to CNT
+   consecutive free swap slots, and returns the first slot. Pages zswap does
+   not take are written to the device with as few requests as possible. The
+   slots stay in use until freed with swap_free(). Returns NO_SWAP_SLOT if
+   there are not CNT consecutive free slots. */
+size_t
+swap_in_cluster(void *buf, size_t cnt, const pid_t *owners)
+{
+    /* Find free slots and set them to occupied.*/
     lock_acquire(&swap_lock);
     size_t free_slot_index =
-            bitmap_scan_and_flip(swap_bitmap, BITMAP_START_INDEX,
-                                    NUM_OF_SLOTS_TO_SWAP, false);
-    lock_release(&swap_lock);
+            bitmap_scan_and_flip(swap_bitmap, BITMAP_START_INDEX, cnt, false);
     if (free_slot_index == BITMAP_ERROR)
         {
-            PANIC("No swap space available.");
+            lock_release(&swap_lock);
+            return NO_SWAP_SLOT;
         }
+    memcpy(swap_owners + free_slot_index, owners, cnt * sizeof *owners);
 
-    int i;
-    for (i = 0; i < SECTORS_PER_PAGE; i++)
-        {
-            block_write(swap_space, 
-                SECTORS_PER_PAGE * free_slot_index + i, 
-                   buf + i * BLOCK_SECTOR_SIZE);
+    /* Write each run of pages zswap does not take with one request. */
+    const uint8_t *pages = buf;
+    size_t run = 0, i;
+    for (i = 0; i < cnt; i++) {
+        if (zswap_put(pages + i * PGSIZE, free_slot_index + i)) {
+            if (run < i) {
+                write_slots(pages + run * PGSIZE, free_slot_index + run,
+                            i - run);
+            }
+            run = i + 1;
         }
+    }
+    if (run < cnt) {
+        write_slots(pages + run * PGSIZE, free_slot_index + run, cnt - run);
+    }
+    lock_release(&swap_lock);
     return free_slot_index;
 }
 
+/* Writes page BUF to SWAP_SLOT, which must be in use, replacing what was
+   there. */
 void
+swap_rewrite(void *buf, size_t swap_slot)
+{
+    lock_acquire(&swap_lock);
+    ASSERT(bitmap_test(swap_bitmap, swap_slot));
+    ra_invalidate(swap_slot);
+    zswap_invalidate(swap_slot);
+    if (!zswap_put(buf, swap_slot)) {
+        write_slots(buf, swap_slot, 1);
+    }
+    lock_release(&swap_lock);
+}
+
+/* Stores page BUF as the contents of SWAP_SLOT in zswap, writing zswap's
+   oldest pages to the device while it is full. Returns false if zswap does
+   not take the page, which must then be written to the device. swap_lock
+   must be held. */
+static bool
+zswap_put(const void *buf, size_t swap_slot)
+{
+    for (;;) {
+        switch (zswap_store(swap_slot, buf)) {
+            case ZSWAP_STORED:
+                return true;
+            case ZSWAP_REJECTED:
+                return false;
+            case ZSWAP_FULL:
+                break;
+        }
+        size_t slot = zswap_writeback(wb_buf);
+        if (slot == NO_SWAP_SLOT) {
+            return false;
+        }
+        write_slots(wb_buf, slot, 1);
+    }
+}
+
+/* Writes the CNT pages at BUF to the CNT slots starting at SWAP_SLOT on the
+   device, with a single request. swap_lock must be held. */
+static void
+write_slots(const void *buf, size_t swap_slot, size_t cnt)
+{
+    block_write_multiple(swap_space, SECTORS_PER_PAGE * swap_slot,
+                         SECTORS_PER_PAGE * cnt, buf);
+    swap_writes++;
+    swap_pages_written += cnt;
+}
+
+/* Reads the page in SWAP_SLOT into BUF, from zswap, the readahead cache, or
+   the device, and returns true if the slot stays in use, so that if the page
+   is evicted again before it is changed, it need not be written out again.
+   A page read from zswap is dropped from it, rather than being kept in
+   memory twice, and its slot is freed, so then returns false. Also asks for
+   the slots after SWAP_SLOT to be read ahead. */
+bool
 swap_out(void *buf, size_t swap_slot)
 {
+    lock_acquire(&swap_lock);
+    ASSERT(bitmap_test(swap_bitmap, swap_slot));
+    bool found = zswap_load(swap_slot, buf);
+    bool kept = !found;
+    if (found) {
+        zswap_invalidate(swap_slot);
+        ra_invalidate(swap_slot);
+        bitmap_reset(swap_bitmap, swap_slot);
+    } else {
+        struct ra_page *p = ra_lookup(swap_slot);
+        if (p != NULL) {
+            memcpy(buf, ra_buf + (p - ra_pages) * PGSIZE, PGSIZE);
+            p->state = RA_FREE;
+            ra_hits++;
+            found = true;
+        }
+    }
+    ra_request = swap_slot;
+    lock_release(&swap_lock);
+    sema_up(&ra_sema);
 
+    if (!found) {
+        block_read_multiple(swap_space, SECTORS_PER_PAGE * swap_slot,
+                            SECTORS_PER_PAGE, buf);
+        swap_reads++;
+    }
+    return kept;
+}
+
+/* Frees SWAP_SLOT, which must be in use. */
+void
+swap_free(size_t swap_slot)
+{
     lock_acquire(&swap_lock);
-    bitmap_flip(swap_bitmap, swap_slot);
+    ASSERT(bitmap_test(swap_bitmap, swap_slot));
+    bitmap_reset(swap_bitmap, swap_slot);
+    ra_invalidate(swap_slot);
+    zswap_invalidate(swap_slot);
     lock_release(&swap_lock);
-    int i;
-    for (i = 0; i < SECTORS_PER_PAGE; i++)
-        {
-            block_read(swap_space, 
-                SECTORS_PER_PAGE * swap_slot + i, 
-                  buf + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Returns the readahead cache page holding a valid copy of SWAP_SLOT, or
+   NULL if there is none. swap_lock must be held. */
+static struct ra_page *
+ra_lookup(size_t swap_slot)
+{
+    size_t i;
+
+    for (i = 0; i < SWAP_RA_CACHE; i++) {
+        if (ra_pages[i].state == RA_VALID && ra_pages[i].slot == swap_slot) {
+            return &ra_pages[i];
         }
+    }
+    return NULL;
 }
 
+/* Drops any copy of SWAP_SLOT from the readahead cache, including one still
+   being read. swap_lock must be held. */
+static void
+ra_invalidate(size_t swap_slot)
+{
+    size_t i;
 
+    for (i = 0; i < SWAP_RA_CACHE; i++) {
+        if (ra_pages[i].state != RA_FREE && ra_pages[i].slot == swap_slot) {
+            ra_pages[i].state = RA_FREE;
+        }
+    }
+}
+
+/* Readahead thread. Each time a fault reads a slot, reads the slots after
+   it that belong to the same process into the readahead cache, stopping
+   early if another fault comes in. */
+static void
+swapra(void *aux UNUSED)
+{
+    for (;;) {
+        sema_down(&ra_sema);
+
+        lock_acquire(&swap_lock);
+        size_t slot = ra_request;
+        ra_request = NO_SWAP_SLOT;
+        pid_t owner = slot != NO_SWAP_SLOT ? swap_owners[slot] : 0;
+        lock_release(&swap_lock);
+        if (slot == NO_SWAP_SLOT) {
+            continue;
+        }
+
+        size_t s;
+        for (s = slot + 1; s <= slot + SWAP_RA_WINDOW
+                           && s < (size_t) pages_in_swap_space; s++) {
+            lock_acquire(&swap_lock);
+            if (ra_request != NO_SWAP_SLOT) {
+                lock_release(&swap_lock);
+                break;
+            }
+            if (!bitmap_test(swap_bitmap, s) || swap_owners[s] != owner
+                || zswap_contains(s) || ra_lookup(s) != NULL) {
+                lock_release(&swap_lock);
+                continue;
+            }
+            /* Only this thread fills the cache, so no other page is
+               RA_LOADING and the page taken is not reused under us. */
+            struct ra_page *p = &ra_pages[ra_hand];
+            ra_hand = (ra_hand + 1) % SWAP_RA_CACHE;
+            p->slot = s;
+            p->state = RA_LOADING;
+            lock_release(&swap_lock);
+
+            block_read_multiple(swap_space, SECTORS_PER_PAGE * s,
+                                SECTORS_PER_PAGE,
+                                ra_buf + (p - ra_pages) * PGSIZE);
+
+            lock_acquire(&swap_lock);
+            if (p->state == RA_LOADING) {
+                p->state = RA_VALID;
+            }
+            ra_reads++;
+            lock_release(&swap_lock);
+        }
+    }
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats(void)
+{
+    printf("Swap: %llu pages written in %llu requests; %llu pages read, "
+           "%llu read ahead, %llu readahead hits\n",
+           swap_pages_written, swap_writes, swap_reads, ra_reads, ra_hits);
+    zswap_print_stats();
+}
@@ -1,15 +1,24 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 
+#include <stdint.h>
 #include "threads/vaddr.h"
 #include "devices/block.h"
+#include "userprog/process.h"
 
 #define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
 #define BITMAP_START_INDEX 0
 #define NUM_OF_SLOTS_TO_SWAP 1
 
+/* Swap slot of a page that has none. */
+#define NO_SWAP_SLOT SIZE_MAX
+
 void swap_init(void);
-void swap_out(void *, size_t);
-size_t swap_in(void *);
+bool swap_out(void *, size_t);
+size_t swap_in(void *, pid_t owner);
+size_t swap_in_cluster(void *, size_t cnt, const pid_t *owners);
+void swap_rewrite(void *, size_t);
+void swap_free(size_t);
+void swap_print_stats(void);
 
 #endif /* vm/swap.h */
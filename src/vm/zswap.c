@@ -0,0 +1,468 @@
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+#include "vm/swap.h"
+
+/* Compressed swap cache.
+
+   swap.c offers each page it writes to a swap slot to zswap_store() first,
+   and only writes it to the swap device if zswap does not take it. A page
+   whose words are all the same, such as a page of zeros, is stored as that
+   one word. Any other page is compressed, with the LZ77 compressor below,
+   into the arena, as long as it compresses to at most ZSWAP_MAX_SIZE bytes.
+   The arena is up to arena_page_cnt pages of the kernel pool, divided into
+   ZSWAP_UNIT-byte units. Its pages are taken from the pool only as they are
+   needed, and each is given back once it holds nothing, so that zswap costs
+   no memory until pages are swapped. A compressed page never straddles two
+   arena pages. When the arena is full, or the kernel pool is empty, swap.c
+   makes room by taking the oldest compressed page from zswap_writeback()
+   and writing it to its slot on the swap device.
+
+   zswap keeps no lock of its own: swap.c calls it with swap_lock held. */
+
+/* Size of an arena allocation unit. */
+#define ZSWAP_UNIT 64
+
+/* Units in an arena page. */
+#define UNITS_PER_PAGE (PGSIZE / ZSWAP_UNIT)
+
+/* Most pages in the arena by default. */
+#define ZSWAP_DEFAULT_MAX 2048
+
+/* Largest compressed page worth storing. */
+#define ZSWAP_MAX_SIZE (PGSIZE / 4 * 3)
+
+/* What a slot holds. */
+enum zslot_state {
+  ZS_EMPTY, /* Nothing: the slot is free or its page is on disk. */
+  ZS_FILLED, /* A page filled with the word in data. */
+  ZS_COMPRESSED /* A page compressed to size bytes at unit data. */
+};
+
+/* Per-slot state. */
+struct zslot {
+  enum zslot_state state;
+  uint32_t data; /* Fill word, or first unit in the arena. */
+  uint16_t size; /* Compressed size in bytes. */
+  struct list_elem lru_elem; /* In lru if compressed. */
+};
+
+int zswap_pages = -1;
+
+static struct zslot *zslots; /* Indexed by swap slot, null if disabled. */
+static uint8_t **arena; /* Pages of compressed pages, null if not taken. */
+static uint16_t *arena_units; /* Units in use in each page of arena. */
+static size_t arena_page_cnt; /* Most pages in arena. */
+static struct bitmap *arena_map; /* Units of arena in use. */
+static struct list lru; /* Compressed pages, oldest at the front. */
+
+/* Statistics. */
+static size_t filled_cnt; /* Same-filled pages held. */
+static size_t compressed_cnt; /* Compressed pages held. */
+static size_t compressed_bytes; /* Bytes of compressed pages held. */
+static size_t units_used; /* Units of arena in use. */
+static size_t arena_pages_used; /* Pages of arena taken from the pool. */
+static unsigned long long stores; /* Pages stored. */
+static unsigned long long loads; /* Pages loaded. */
+static unsigned long long rejects; /* Pages that did not compress well. */
+static unsigned long long writebacks; /* Pages written back to disk. */
+
+/* LZ77 compression.
+
+   The compressed form is a sequence of runs, each made of a token byte, a
+   run of literal bytes, and a match that copies earlier output. The high
+   nibble of the token is the number of literals and the low nibble is the
+   length of the match less LZ_MIN_MATCH; a nibble of 15 is followed by
+   bytes that are added to it, up to and including the first that is not
+   255. The literals come next, then the distance back to the match, in 2
+   bytes, little-endian, then any extra match length bytes. The last run has
+   no match, and ends the input. Matches are found through a hash table of
+   the last position at which each hash of 4 bytes was seen, as in LZ4. */
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+static uint16_t lz_table[1 << LZ_HASH_BITS]; /* Positions plus 1, or 0. */
+
+static uint32_t
+read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+static size_t
+lz_hash(uint32_t v) {
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends LEN to the output at *OP, which must stay before END, as the
+   extra bytes of a length of 15 or more. Returns false if out of room. */
+static bool
+put_length(uint8_t **op, const uint8_t *end, size_t len) {
+  for (len -= 15; ; len -= 255) {
+    if (*op >= end) {
+      return false;
+    }
+    *(*op)++ = len < 255 ? len : 255;
+    if (len < 255) {
+      return true;
+    }
+  }
+}
+
+/* Appends a run of LIT_CNT literals from LIT, followed by a match of
+   MATCH_LEN bytes at distance DIST if MATCH_LEN is nonzero, to the output
+   at *OP, which must stay before END. Returns false if out of room. */
+static bool
+put_run(uint8_t **op, const uint8_t *end, const uint8_t *lit, size_t lit_cnt,
+        size_t dist, size_t match_len) {
+  size_t ml = match_len != 0 ? match_len - LZ_MIN_MATCH : 0;
+  uint8_t *token = *op;
+
+  if (*op >= end) {
+    return false;
+  }
+  *token = (lit_cnt < 15 ? lit_cnt : 15) << 4 | (ml < 15 ? ml : 15);
+  (*op)++;
+  if (lit_cnt >= 15 && !put_length(op, end, lit_cnt)) {
+    return false;
+  }
+  if ((size_t) (end - *op) < lit_cnt) {
+    return false;
+  }
+  memcpy(*op, lit, lit_cnt);
+  *op += lit_cnt;
+  if (match_len == 0) {
+    return true;
+  }
+  if (end - *op < 2) {
+    return false;
+  }
+  *(*op)++ = dist & 0xff;
+  *(*op)++ = dist >> 8;
+  return ml < 15 || put_length(op, end, ml);
+}
+
+/* Compresses the page at SRC into DST, which has room for DST_SIZE bytes.
+   Returns the compressed size, or 0 if it is more than DST_SIZE. */
+static size_t
+lz_compress(const uint8_t *src, uint8_t *dst, size_t dst_size) {
+  const uint8_t *end = dst + dst_size;
+  uint8_t *op = dst;
+  size_t ip = 0, anchor = 0;
+
+  memset(lz_table, 0, sizeof lz_table);
+  while (ip + LZ_MIN_MATCH <= PGSIZE) {
+    uint32_t v = read32(src + ip);
+    size_t h = lz_hash(v);
+    size_t ref = lz_table[h];
+    lz_table[h] = ip + 1;
+    if (ref == 0 || read32(src + ref - 1) != v) {
+      ip++;
+      continue;
+    }
+    ref--;
+
+    size_t len = LZ_MIN_MATCH;
+    while (ip + len < PGSIZE && src[ref + len] == src[ip + len]) {
+      len++;
+    }
+    if (!put_run(&op, end, src + anchor, ip - anchor, ip - ref, len)) {
+      return 0;
+    }
+    ip += len;
+    anchor = ip;
+  }
+  if (!put_run(&op, end, src + anchor, PGSIZE - anchor, 0, 0)) {
+    return 0;
+  }
+  return op - dst;
+}
+
+/* Reads the extra bytes of a length of 15 or more at *IP and adds them to
+   *LEN. */
+static void
+get_length(const uint8_t **ip, size_t *len) {
+  uint8_t b;
+  do {
+    b = *(*ip)++;
+    *len += b;
+  } while (b == 255);
+}
+
+/* Decompresses the SIZE bytes at SRC, compressed by lz_compress(), into the
+   page at DST. */
+static void
+lz_decompress(const uint8_t *src, size_t size, uint8_t *dst) {
+  const uint8_t *ip = src, *end = src + size;
+  uint8_t *op = dst;
+
+  for (;;) {
+    uint8_t token = *ip++;
+    size_t lit_cnt = token >> 4;
+    if (lit_cnt == 15) {
+      get_length(&ip, &lit_cnt);
+    }
+    ASSERT(op + lit_cnt <= dst + PGSIZE);
+    memcpy(op, ip, lit_cnt);
+    op += lit_cnt;
+    ip += lit_cnt;
+    if (ip >= end) {
+      break;
+    }
+
+    size_t dist = ip[0] | ip[1] << 8;
+    size_t len = token & 15;
+    ip += 2;
+    if (len == 15) {
+      get_length(&ip, &len);
+    }
+    len += LZ_MIN_MATCH;
+    ASSERT(dist > 0 && dist <= (size_t) (op - dst));
+    ASSERT(op + len <= dst + PGSIZE);
+    /* The match may overlap the output, so copy a byte at a time. */
+    for (; len > 0; len--, op++) {
+      *op = op[-dist];
+    }
+  }
+  ASSERT(op == dst + PGSIZE);
+}
+
+/* Sets up the state of SLOT_CNT swap slots, and of an arena of up to
+   zswap_pages pages, none of which are taken yet. By default, the arena may
+   grow to a quarter of the free kernel pool, up to ZSWAP_DEFAULT_MAX pages.
+   Does nothing if zswap_pages is 0. */
+void
+zswap_init(size_t slot_cnt) {
+  if (zswap_pages >= 0) {
+    arena_page_cnt = zswap_pages;
+  } else {
+    arena_page_cnt = palloc_free_cnt(0) / 4;
+    if (arena_page_cnt > ZSWAP_DEFAULT_MAX) {
+      arena_page_cnt = ZSWAP_DEFAULT_MAX;
+    }
+  }
+  if (arena_page_cnt == 0) {
+    return;
+  }
+  zslots = vmalloc(slot_cnt * sizeof *zslots);
+  arena = vmalloc(arena_page_cnt * sizeof *arena);
+  arena_units = vmalloc(arena_page_cnt * sizeof *arena_units);
+  arena_map = bitmap_create(arena_page_cnt * UNITS_PER_PAGE);
+  if (zslots == NULL || arena == NULL || arena_units == NULL
+      || arena_map == NULL) {
+    PANIC("Couldn't allocate zswap state.");
+  }
+  memset(zslots, 0, slot_cnt * sizeof *zslots);
+  memset(arena, 0, arena_page_cnt * sizeof *arena);
+  memset(arena_units, 0, arena_page_cnt * sizeof *arena_units);
+  list_init(&lru);
+}
+
+/* Returns the address of UNIT of the arena. */
+static uint8_t *
+unit_addr(size_t unit) {
+  return arena[unit / UNITS_PER_PAGE] + unit % UNITS_PER_PAGE * ZSWAP_UNIT;
+}
+
+/* Finds CNT free units of the arena within one page, taking the page from
+   the kernel pool if it has not been, marks them used, and returns the
+   first. Returns BITMAP_ERROR if there are none. */
+static size_t
+alloc_units(size_t cnt) {
+  size_t page, unit;
+
+  for (page = 0; page < arena_page_cnt; page++) {
+    unit = bitmap_scan(arena_map, page * UNITS_PER_PAGE, cnt, false);
+    if (unit == BITMAP_ERROR) {
+      return BITMAP_ERROR;
+    }
+    page = unit / UNITS_PER_PAGE;
+    if (unit + cnt > (page + 1) * UNITS_PER_PAGE) {
+      continue;
+    }
+    if (arena[page] == NULL) {
+      arena[page] = palloc_get_page(0);
+      if (arena[page] == NULL) {
+        continue;
+      }
+      arena_pages_used++;
+    }
+    bitmap_set_multiple(arena_map, unit, cnt, true);
+    arena_units[page] += cnt;
+    return unit;
+  }
+  return BITMAP_ERROR;
+}
+
+/* Frees the CNT units of the arena starting at UNIT, giving their page back
+   to the kernel pool if it holds nothing else. */
+static void
+free_units(size_t unit, size_t cnt) {
+  size_t page = unit / UNITS_PER_PAGE;
+
+  bitmap_set_multiple(arena_map, unit, cnt, false);
+  arena_units[page] -= cnt;
+  if (arena_units[page] == 0) {
+    palloc_free_page(arena[page]);
+    arena[page] = NULL;
+    arena_pages_used--;
+  }
+}
+
+/* Returns true if PAGE is made of one word repeated, and stores the word in
+   *WORD. */
+static bool
+same_filled(const void *page, uint32_t *word) {
+  const uint32_t *w = page;
+  size_t i;
+
+  for (i = 1; i < PGSIZE / sizeof *w; i++) {
+    if (w[i] != w[0]) {
+      return false;
+    }
+  }
+  *word = w[0];
+  return true;
+}
+
+/* Stores PAGE as the contents of SLOT, which must hold nothing. */
+enum zswap_result
+zswap_store(size_t slot, const void *page) {
+  static uint8_t buf[ZSWAP_MAX_SIZE];
+  struct zslot *z;
+  uint32_t word;
+  size_t size, units, unit;
+
+  if (zslots == NULL) {
+    return ZSWAP_REJECTED;
+  }
+  z = &zslots[slot];
+  ASSERT(z->state == ZS_EMPTY);
+
+  if (same_filled(page, &word)) {
+    z->state = ZS_FILLED;
+    z->data = word;
+    filled_cnt++;
+    stores++;
+    return ZSWAP_STORED;
+  }
+
+  size = lz_compress(page, buf, sizeof buf);
+  if (size == 0) {
+    rejects++;
+    return ZSWAP_REJECTED;
+  }
+  units = DIV_ROUND_UP(size, ZSWAP_UNIT);
+  unit = alloc_units(units);
+  if (unit == BITMAP_ERROR) {
+    return ZSWAP_FULL;
+  }
+  memcpy(unit_addr(unit), buf, size);
+  z->state = ZS_COMPRESSED;
+  z->data = unit;
+  z->size = size;
+  list_push_back(&lru, &z->lru_elem);
+  compressed_cnt++;
+  compressed_bytes += size;
+  units_used += units;
+  stores++;
+  return ZSWAP_STORED;
+}
+
+/* If SLOT holds a page, copies it into PAGE and returns true. The slot
+   keeps holding the page. Otherwise, returns false. */
+bool
+zswap_load(size_t slot, void *page) {
+  struct zslot *z;
+
+  if (zslots == NULL) {
+    return false;
+  }
+  z = &zslots[slot];
+  switch (z->state) {
+    case ZS_EMPTY:
+      return false;
+    case ZS_FILLED: {
+      uint32_t *w = page;
+      size_t i;
+      for (i = 0; i < PGSIZE / sizeof *w; i++) {
+        w[i] = z->data;
+      }
+      loads++;
+      return true;
+    }
+    case ZS_COMPRESSED:
+      lz_decompress(unit_addr(z->data), z->size, page);
+      loads++;
+      return true;
+  }
+  NOT_REACHED();
+}
+
+/* Returns true if SLOT holds a page. */
+bool
+zswap_contains(size_t slot) {
+  return zslots != NULL && zslots[slot].state != ZS_EMPTY;
+}
+
+/* Discards the page held by SLOT, if any. */
+void
+zswap_invalidate(size_t slot) {
+  struct zslot *z;
+
+  if (zslots == NULL) {
+    return;
+  }
+  z = &zslots[slot];
+  if (z->state == ZS_FILLED) {
+    filled_cnt--;
+  } else if (z->state == ZS_COMPRESSED) {
+    size_t units = DIV_ROUND_UP(z->size, ZSWAP_UNIT);
+    free_units(z->data, units);
+    list_remove(&z->lru_elem);
+    compressed_cnt--;
+    compressed_bytes -= z->size;
+    units_used -= units;
+  }
+  z->state = ZS_EMPTY;
+}
+
+/* Takes the oldest compressed page out of the arena, copying it into PAGE,
+   and returns its slot, so that the caller can write it to disk. Returns
+   NO_SWAP_SLOT if the arena is empty. */
+size_t
+zswap_writeback(void *page) {
+  if (zslots == NULL || list_empty(&lru)) {
+    return NO_SWAP_SLOT;
+  }
+  struct zslot *z = list_entry(list_front(&lru), struct zslot, lru_elem);
+  size_t slot = z - zslots;
+  lz_decompress(unit_addr(z->data), z->size, page);
+  zswap_invalidate(slot);
+  writebacks++;
+  return slot;
+}
+
+/* Prints zswap statistics. */
+void
+zswap_print_stats(void) {
+  if (zslots == NULL) {
+    return;
+  }
+  printf("Zswap: %zu same-filled pages, %zu pages compressed to %zu KB, "
+         "using %zu KB in %zu of %zu pages; %llu stored, %llu loaded, "
+         "%llu rejected, %llu written back\n",
+         filled_cnt, compressed_cnt, compressed_bytes / 1024,
+         units_used * ZSWAP_UNIT / 1024, arena_pages_used, arena_page_cnt,
+         stores, loads, rejects, writebacks);
+}
@@ -0,0 +1,29 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Compressed swap cache. Holds the contents of swap slots in memory,
+   compressed, in front of the swap device. See vm/zswap.c. */
+
+/* Results of zswap_store(). */
+enum zswap_result {
+  ZSWAP_STORED, /* Page stored. */
+  ZSWAP_REJECTED, /* Page does not compress well enough to be worth it. */
+  ZSWAP_FULL /* Not enough room in the arena. */
+};
+
+/* Most pages in the arena, -1 for the default, or 0 to disable the cache.
+   Controlled by kernel command-line option "-zswap". */
+extern int zswap_pages;
+
+void zswap_init(size_t slot_cnt);
+enum zswap_result zswap_store(size_t slot, const void *page);
+bool zswap_load(size_t slot, void *page);
+bool zswap_contains(size_t slot);
+void zswap_invalidate(size_t slot);
+size_t zswap_writeback(void *page);
+void zswap_print_stats(void);
+
+#endif /* vm/zswap.h */